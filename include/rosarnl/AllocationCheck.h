@@ -0,0 +1,45 @@
+#ifndef _ROSARNL_ALLOCATIONCHECK_H_
+#define _ROSARNL_ALLOCATIONCHECK_H_
+
+/**
+ * Test mode check that a steady-state code path does not use the heap.
+ *
+ * Wrap the message building part of a periodic function in begin()/end().
+ * When rosarnl is built with ROSARNL_ALLOC_CHECK, a replacement global
+ * operator new counts allocations made by each thread, and end() aborts the
+ * node with a fatal log message if any allocation happened between begin()
+ * and end() once the first @a warmup cycles are over. (Warm-up cycles are
+ * allowed to allocate, e.g. to grow reused buffers to their working size.)
+ *
+ * Calls into roscpp or actionlib to actually publish a message are not
+ * checked, since their serialization buffers are outside our control; keep
+ * them outside begin()/end().
+ *
+ * In normal builds begin() and end() are empty inline functions.
+ */
+class AllocationCheck
+{
+public:
+  AllocationCheck(const char *_name, unsigned long _warmup = 50) :
+    name(_name), warmup(_warmup), cycles(0), start_count(0)
+  {}
+
+#ifdef ROSARNL_ALLOC_CHECK
+  void begin();
+  void end();
+
+  /// Total heap allocations made so far by the calling thread.
+  static unsigned long threadAllocations();
+#else
+  void begin() {}
+  void end() {}
+#endif
+
+protected:
+  const char *name;
+  unsigned long warmup;
+  unsigned long cycles;
+  unsigned long start_count;
+};
+
+#endif
@@ -1,19 +1,15 @@
-
 #ifndef ARTIMETOROSTIMESTAMP_H
 #define ARTIMETOROSTIMESTAMP_H
 
 #include <ros/ros.h>
 #include "ariaUtil.h"
+#include "ClockMapping.h"
 
-ros::Time convertArTimeToROS(const ArTime& t)
+/// ARIA/ARNL times are in reference to an arbitrary starting time, not the
+/// OS clock; map @a t onto ROS time using the filtered clock mapping.
+inline ros::Time convertArTimeToROS(const ArTime& t)
 {
-  // ARIA/ARNL times are in reference to an arbitrary starting time, not OS
-  // clock, so find the time elapsed between now and t
-  // to adjust the time stamp in ROS time vs. now accordingly.
-  ArTime arianow;
-  const double dtsec = (double) t.mSecSince(arianow) / 1000.0;
-  //printf("was %f seconds ago\n", dtsec);
-  return ros::Time(ros::Time::now().toSec() - dtsec);
+  return ClockMapping::instance().toROS(t);
 }
 
 #endif
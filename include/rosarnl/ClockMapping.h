@@ -0,0 +1,127 @@
+#ifndef _ROSARNL_CLOCKMAPPING_H_
+#define _ROSARNL_CLOCKMAPPING_H_
+
+#include <ros/ros.h>
+#include "ariaUtil.h"
+
+#include <atomic>
+#include <cstdint>
+
+/// Seconds from ArTime @a from to ArTime @a to, positive if @a to is later.
+/// (ArTime::mSecSince() reads the other way round: a.mSecSince(b) is b - a.)
+inline double ariaDeltaSec(const ArTime& from, const ArTime& to)
+{
+  return from.mSecSince(to) / 1000.0;
+}
+
+/**
+ * Maps ARIA's monotonic ArTime clock onto ROS time.
+ *
+ * ArTime values count from an arbitrary reference, so timestamps taken by
+ * ARIA (laser readings, SIP packets, localization) have to be moved onto the
+ * ROS clock before being published. Rather than reading both clocks on every
+ * conversion, which adds the scheduling jitter between the two reads to
+ * every stamp, the mapping is estimated at a low rate by update() and kept
+ * as an offset plus a drift rate:
+ *
+ *   ros = aria + offset + drift * (aria - aria_ref)
+ *
+ * where aria is seconds since a fixed ArTime taken at construction.
+ * update() takes several back-to-back clock pairs and keeps the tightest,
+ * then feeds it through a second order (alpha-beta) filter. A residual
+ * larger than step_threshold plus an allowance for clock rate error over the
+ * time since the last sample (a ROS clock jump, e.g. sim time or an NTP
+ * step) restarts the filter from the new sample. The allowance is wide until
+ * the drift has been learned, so a simulated clock running at a steady real
+ * time factor other than 1 is tracked rather than reset on every update.
+ *
+ * Parameters are published through a sequence lock (see CmdVelMailbox), so
+ * toROS() is lock free and safe to call from any thread. Only one thread may
+ * call update().
+ */
+class ClockMapping
+{
+public:
+  struct Quality
+  {
+    double residual_ms;     ///< last sample minus prediction
+    double jitter_ms;       ///< RMS of residuals (exponentially weighted)
+    double drift_ppm;       ///< ROS clock rate relative to ARIA's
+    double read_gap_ms;     ///< ROS clock read bracket of the kept sample
+    double age;             ///< sec since the last update
+    unsigned long samples;  ///< total updates
+    unsigned long resets;   ///< filter restarts on clock steps
+  };
+
+  static ClockMapping& instance();
+
+  /// Convert an ARIA time to ROS time. Lock free. Times before the ROS
+  /// epoch (e.g. readings taken before the first /clock message in
+  /// simulation) come out as zero, since ros::Time can't be negative.
+  ros::Time toROS(const ArTime& t) const
+  {
+    const double a = ariaSec(t);
+    double off, drift, ref;
+    readParams(off, drift, ref);
+    const double r = a + off + drift * (a - ref);
+    return r > 0 ? ros::Time(r) : ros::Time(0);
+  }
+
+  /// Sample both clocks and update the estimate. Call at about 1 Hz.
+  void update();
+
+  /// Feed one pair of simultaneous readings (ARIA seconds as from ariaSec(),
+  /// ROS seconds) into the filter. Called by update().
+  void addSample(double aria, double ros_sec, double read_gap);
+
+  Quality getQuality() const;
+
+  /// Seconds since the reference ArTime
+  double ariaSec(const ArTime& t) const { return ariaDeltaSec(ref_time, t); }
+
+  static constexpr double step_threshold = 0.05;  // sec
+
+private:
+  ClockMapping();
+
+  void readParams(double& off, double& drift, double& ref) const
+  {
+    for(;;)
+    {
+      const unsigned long s1 = seq.load(std::memory_order_acquire);
+      if(s1 & 1)
+        continue; // update in progress
+      off = offset_pub.load(std::memory_order_relaxed);
+      drift = drift_pub.load(std::memory_order_relaxed);
+      ref = ref_pub.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if(seq.load(std::memory_order_relaxed) == s1)
+        return;
+    }
+  }
+  void writeParams(double off, double drift, double ref);
+
+  const ArTime ref_time;
+
+  std::atomic<unsigned long> seq;
+  std::atomic<double> offset_pub;
+  std::atomic<double> drift_pub;
+  std::atomic<double> ref_pub;
+
+  // Filter state, only touched by the updating thread
+  double offset;      // ros - aria at last_aria (sec)
+  double drift;       // sec/sec
+  double last_aria;
+  unsigned long samples;
+  unsigned long resets;
+
+  // Diagnostics, written by the updating thread, read by anyone
+  std::atomic<double> residual_ms;
+  std::atomic<double> jitter_sq;
+  std::atomic<double> read_gap_ms;
+  std::atomic<double> last_update_ros;
+  std::atomic<unsigned long> samples_pub;
+  std::atomic<unsigned long> resets_pub;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef _ROSARNL_CMDVELMAILBOX_H_
+#define _ROSARNL_CMDVELMAILBOX_H_
+
+#include <atomic>
+#include <chrono>
+
+/**
+ * Single-slot, lock-free "latest value" mailbox for velocity commands.
+ *
+ * The writer (the cmd_vel subscriber callback) always overwrites the slot;
+ * the reader (an ArRobot user task) only ever wants the most recent command.
+ * Implemented as a sequence lock: the writer makes the sequence number odd
+ * while it stores the fields and even again when done, and the reader
+ * retries if the sequence changed while it was copying. Neither side ever
+ * blocks, so the robot cycle is never held up by ROS callbacks.
+ *
+ * Only one thread may write at a time. roscpp never runs callbacks for the
+ * same subscription concurrently, so the cmd_vel callback meets that.
+ */
+class CmdVelMailbox
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Command
+  {
+    double vel;         ///< mm/sec
+    double latVel;      ///< mm/sec
+    double rotVel;      ///< deg/sec
+    Clock::time_point received;
+    unsigned long seq;  ///< increases by one for each command written
+  };
+
+  CmdVelMailbox() : seq(0), count(0), vel(0), latVel(0), rotVel(0), received_ns(0) {}
+
+  void write(double _vel, double _latVel, double _rotVel, Clock::time_point _received)
+  {
+    const unsigned long s = seq.load(std::memory_order_relaxed);
+    seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    vel.store(_vel, std::memory_order_relaxed);
+    latVel.store(_latVel, std::memory_order_relaxed);
+    rotVel.store(_rotVel, std::memory_order_relaxed);
+    received_ns.store(_received.time_since_epoch().count(), std::memory_order_relaxed);
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    seq.store(s + 2, std::memory_order_release);
+  }
+
+  /// @return false if nothing has been written yet.
+  bool read(Command& cmd) const
+  {
+    for(;;)
+    {
+      const unsigned long s1 = seq.load(std::memory_order_acquire);
+      if(s1 & 1)
+        continue; // write in progress
+      cmd.vel = vel.load(std::memory_order_relaxed);
+      cmd.latVel = latVel.load(std::memory_order_relaxed);
+      cmd.rotVel = rotVel.load(std::memory_order_relaxed);
+      cmd.received = Clock::time_point(Clock::duration(received_ns.load(std::memory_order_relaxed)));
+      cmd.seq = count.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if(seq.load(std::memory_order_relaxed) == s1)
+        return cmd.seq != 0;
+    }
+  }
+
+private:
+  std::atomic<unsigned long> seq;
+  std::atomic<unsigned long> count;
+  std::atomic<double> vel;
+  std::atomic<double> latVel;
+  std::atomic<double> rotVel;
+  std::atomic<Clock::rep> received_ns;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef _ROSARNL_COVARIANCEWORKER_H_
+#define _ROSARNL_COVARIANCEWORKER_H_
+
+#include "ariaUtil.h"
+#include "RosArnlConfig.h"
+
+#include <boost/function.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class ArLocalizationTask;
+
+/**
+ * Computes ARNL's localization mean and variance in its own thread, at
+ * the configured covariance_rate, and caches the most recent result.
+ *
+ * ArLocalizationTask::findLocalizationMeanVar() walks the whole sample set,
+ * so it is only called while use_covariance is set and the wanted functor
+ * (normally "amcl_pose has subscribers") returns true. The publishing thread
+ * just copies the cached matrix with getLatest().
+ */
+class CovarianceWorker
+{
+public:
+  CovarianceWorker(ArLocalizationTask *_locTask, const RosArnlConfigStore& _config, const boost::function<bool()>& _wanted);
+  ~CovarianceWorker();
+
+  void start();
+  void stop();
+
+  /**
+   * Copy the most recent variance matrix (ARNL units: mm and degrees, row
+   * major x, y, th) and the time of the localization it was computed from.
+   * @return false if no result has been computed yet.
+   */
+  bool getLatest(double var[9], ArTime& locTime) const;
+
+protected:
+  void threadMain();
+
+  ArLocalizationTask *locTask;
+  const RosArnlConfigStore& config;
+  boost::function<bool()> wanted;
+
+  mutable std::mutex result_mutex;
+  double latest_var[9];
+  ArTime latest_loc_time;
+  bool have_result;
+
+  std::mutex wait_mutex;
+  std::condition_variable wait_cond;
+  std::atomic<bool> running;
+  std::thread thread;
+};
+
+#endif
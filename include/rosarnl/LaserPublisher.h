@@ -4,30 +4,174 @@
 #include <ros/ros.h>
 #include <sensor_msgs/LaserScan.h>
 #include <sensor_msgs/PointCloud.h>
-#include <tf/transform_broadcaster.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <tf2_ros/static_transform_broadcaster.h>
+#include <rosarnl/CompactScan.h>
+#include <rosarnl/CumulativeCloudDelta.h>
 
+#include "ariaUtil.h"
+#include "AllocationCheck.h"
+#include "LatencyHistogram.h"
+#include "LaserScanBuilder.h"
+#include "RangeConversion.h"
+#include "ScanTimeEstimator.h"
+#include "MergedScanPublisher.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ArLaser;
+
+/**
+ * Publishes an ArLaser's readings as LaserScan, PointCloud and PointCloud2
+ * messages. The laser's mount transform (parent frame to laser frame) is
+ * published once, on /tf_static.
+ *
+ * The laser's reading callback only copies the raw data (see LaserCapture)
+ * while it holds the laser's device lock, which ARNL localization and the
+ * laser driver also need. The messages are built and published by a
+ * separate thread for each laser.
+ */
 class LaserPublisher
 {
 public:
-  LaserPublisher(ArLaser* _l, ros::NodeHandle& _n, bool _broadcast_transform = true, const std::string& _tf_frame = "laser_frame", const std::string& _parent_tf_frame = "base_link", const std::string& _global_tf_frame = "map");
+  /**
+   * @param _static_tf  broadcaster for the mount transform, shared by all of
+   *   the node's static transforms (one latched /tf_static publisher)
+   * @param _tf_frame  frame of the laser's scans, unique to this laser
+   * @param _parent_tf_frame  frame the laser is mounted on (robot base)
+   * @param _cloud_frame  frame of ARIA's global coordinates, for point clouds
+   */
+  LaserPublisher(ArLaser* _l, ros::NodeHandle& _n, tf2_ros::StaticTransformBroadcaster& _static_tf, const std::string& _tf_frame, const std::string& _parent_tf_frame, const std::string& _cloud_frame);
   ~LaserPublisher();
+
+  /// Also contribute this laser's scans to @a m.
+  void setMergedScanPublisher(MergedScanPublisher *m);
+
+  /**
+   * Publish fewer scans while the wireless link quality
+   * (ArSystemStatus::getWirelessLinkQuality()) is below @a full_rate_quality,
+   * skipping up to @a max_skip scans between published ones. 0 disables.
+   */
+  void setAdaptiveRate(int full_rate_quality, int max_skip);
+
+  /// Send a keyframe every @a interval cumulative_delta messages.
+  void setCumulativeKeyframeInterval(int interval);
+
 protected:
+  /// Raw data from one laser reading, copied under the device lock.
+  struct LaserCapture
+  {
+    ArTime time;
+    bool flipped;
+    std::vector<uint32_t> ranges;       ///< raw readings (mm) in laser order
+    std::vector<uint32_t> ignore_mask;  ///< getIgnoreThisReading() bits, see RangeConversion.h
+    std::vector<int> intensities;       ///< getExtraInt() of each raw reading, if have_intensities
+    bool have_cloud;
+    std::vector<float> cloud_xy;        ///< current buffer points (m), x y pairs
+    bool have_cumulative;
+    std::vector<uint64_t> cumulative;   ///< cumulative buffer points, see cumulativeKey()
+  };
+
   void readingsCB();
-  void publishLaserScan();
-  void publishPointCloud();
+  void publishThreadMain();
+
+  /// True if any output of this laser has subscribers.
+  bool wanted() const;
+  void subscribersChanged(const ros::SingleSubscriberPublisher&);
+  /// Register or remove laserReadingsCB according to wanted().
+  void updateActivation();
+
+  bool throttleScan();
+  void buildLaserScan(const LaserCapture& c);
+  void publishCompactScan();
+  void publishPointCloud(const LaserCapture& c);
+  void publishPointCloud2(const LaserCapture& c);
+  void addMergedScan(const LaserCapture& c);
+  void publishCumulativeDelta(const LaserCapture& c);
+  static void appendCumulativePoint(std::vector<int32_t>& v, uint64_t key)
+  {
+    v.push_back((int32_t)(uint32_t)(key >> 32));
+    v.push_back((int32_t)(uint32_t)key);
+  }
+
+  /// Cumulative buffer point as x and y mm packed in a sortable key
+  static uint64_t cumulativeKey(int32_t x, int32_t y) { return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y; }
 
   ArFunctorC<LaserPublisher> laserReadingsCB;
+  bool reading_cb_active;
+  std::mutex activation_mutex;
   ros::NodeHandle& node;
   ArLaser *laser;
-  ros::Publisher laserscan_pub, pointcloud_pub;
+  ros::Publisher laserscan_pub, pointcloud_pub, pointcloud2_pub, compact_pub, cumulative_pub;
   sensor_msgs::LaserScan laserscan;
+  rosarnl::CompactScan compact_scan;
   sensor_msgs::PointCloud  pointcloud;
+  sensor_msgs::PointCloud2 pointcloud2;  ///< packed float32 x, y, z
+  float sensor_z;  ///< height of the laser (m), the z of all cloud points
+  /// Laser geometry and output modes, from the <laser>_decimation,
+  /// <laser>_crop_min and <laser>_crop_max parameters
+  LaserScanBuilder scan_builder;
+  bool have_intensities;  ///< laser reports reflectance in getExtraInt()
+  double fixed_scan_time; ///< <laser>_scan_time parameter (sec), 0 to measure
+  ScanTimeEstimator scan_time_est;  ///< measured scan period
   std::string tfname;
   std::string parenttfname;
-  std::string globaltfname;
-  tf::Transform lasertf;
-  tf::TransformBroadcaster transform_broadcaster;
-  bool broadcast_tf;
+
+  // readingsCB() fills back, then swaps it with ready. The publishing thread
+  // swaps ready with front and builds messages from front. Only vector
+  // storage is exchanged, so nothing is allocated once the buffers have
+  // grown to a full scan.
+  LaserCapture capture_back;
+  LaserCapture capture_ready;
+  LaserCapture capture_front;
+  bool capture_fresh;
+  std::mutex capture_mutex;
+  std::condition_variable capture_cond;
+  std::atomic<bool> publish_thread_running;
+  std::thread publish_thread;
+
+  // Merged scan (optional). Readings from laserscan are transformed into the
+  // base frame with the laser's mount position, using a table of beam angle
+  // cos/sin in that frame.
+  std::atomic<MergedScanPublisher*> merged_scan;
+  size_t merged_index;
+  size_t max_readings;
+  double mount_x, mount_y, mount_th;  ///< m, m, rad
+  std::vector<float> beam_cos, beam_sin;
+  float beam_table_increment;
+  std::vector<float> merged_xy;
+
+  // Adaptive rate, see setAdaptiveRate()
+  std::atomic<int> link_quality_full_rate;
+  std::atomic<int> max_scan_skip;
+  int scan_skip;     ///< current number of scans skipped between published ones
+  int scans_skipped; ///< scans skipped since the last published one
+
+  // Cumulative buffer deltas. cumulative_sent is the sorted buffer as of the
+  // last message sent.
+  rosarnl::CumulativeCloudDelta cumulative_delta;
+  std::vector<uint64_t> cumulative_sent;
+  std::vector<uint64_t> cumulative_diff;
+  std::atomic<int> cumulative_keyframe_interval;
+  int cumulative_since_keyframe;
+  uint32_t cumulative_subscribers;
+
+  AllocationCheck capture_alloc_check;
+  AllocationCheck scan_alloc_check;
+  AllocationCheck compact_alloc_check;
+  AllocationCheck cloud_alloc_check;
+  AllocationCheck cumulative_alloc_check;
+  LatencyHistogram readings_latency;
+  LatencyHistogram lock_hold_latency;
+  LatencyHistogram scan_latency;
+  LatencyHistogram compact_latency;
+  LatencyHistogram cloud_latency;
+  LatencyHistogram cloud2_latency;
+  LatencyHistogram cumulative_latency;
 };
 
 #endif
@@ -0,0 +1,46 @@
+#ifndef _ROSARNL_LASERSCANBUILDER_H_
+#define _ROSARNL_LASERSCANBUILDER_H_
+
+#include <sensor_msgs/LaserScan.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Builds a LaserScan from the raw readings of one scan (see
+ * LaserPublisher::LaserCapture), applying the laser's output modes: ranges
+ * are converted with convertRanges(), readings outside crop_min..crop_max are
+ * marked -1, and only every decimation'th reading is kept.
+ *
+ * The fields describe the laser and are set once by LaserPublisher. build()
+ * only resizes the message's vectors, so on a reused message it does not
+ * allocate once the first full scan has been built.
+ */
+struct LaserScanBuilder
+{
+  double angle_min;        ///< start angle of the laser's full scan (rad)
+  double angle_max;        ///< end angle of the laser's full scan (rad)
+  double angle_increment;  ///< configured reading spacing of the laser (rad)
+  double range_max;        ///< maximum range of the laser (m)
+  int decimation;          ///< publish every decimation'th reading
+  double crop_min;         ///< readings closer than this (m) are dropped
+  double crop_max;         ///< readings further than this (m) are dropped, 0 for no limit
+
+  LaserScanBuilder() :
+    angle_min(0), angle_max(0), angle_increment(0), range_max(0),
+    decimation(1), crop_min(0), crop_max(0)
+  {}
+
+  /**
+   * Fill the angles, timing, ranges and intensities of @a scan (header,
+   * range_min and range_max are left alone).
+   * @param mm,ignore_mask,n,flipped  raw readings, as for convertRanges()
+   * @param intensities  @a n_intensities values in laser order (0 if none)
+   * @param scan_time    time between scans (sec), 0 if not known
+   */
+  void build(const uint32_t *mm, const uint32_t *ignore_mask, size_t n, bool flipped,
+             const int *intensities, size_t n_intensities, double scan_time,
+             sensor_msgs::LaserScan& scan) const;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef _ROSARNL_LATENCYHISTOGRAM_H_
+#define _ROSARNL_LATENCYHISTOGRAM_H_
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * Lock-free log-linear histogram of durations in nanoseconds.
+ *
+ * Each power of two is split into 8 linear sub-buckets, so any recorded
+ * value is known to within 12.5%. record() is a couple of relaxed atomic
+ * increments and is safe to call from any number of threads, including ARIA
+ * task and laser threads.
+ *
+ * Histograms register themselves with LatencyRegistry by name, which
+ * RosArnlNode::publishDiagnostics() uses to report p50/p99/max for each one.
+ */
+class LatencyHistogram
+{
+public:
+  struct Summary
+  {
+    uint64_t count;
+    double p50_ms;
+    double p99_ms;
+    double max_ms;
+  };
+
+  LatencyHistogram(const std::string& _name);
+  ~LatencyHistogram();
+
+  void record(int64_t ns)
+  {
+    const uint64_t v = (ns > 0) ? (uint64_t)ns : 0;
+    buckets[bucketIndex(v)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t m = max_ns.load(std::memory_order_relaxed);
+    while(v > m && !max_ns.compare_exchange_weak(m, v, std::memory_order_relaxed))
+      ;
+  }
+
+  /// Summarize everything recorded since the last call and start over.
+  Summary takeSummary();
+
+  const std::string& getName() const { return name; }
+
+  static const int SubBucketBits = 3;
+  static const int SubBuckets = 1 << SubBucketBits;
+  static const int NumBuckets = (64 - SubBucketBits + 1) * SubBuckets;
+
+  static int bucketIndex(uint64_t v)
+  {
+    if(v < (uint64_t)SubBuckets)
+      return (int)v;
+    const int e = 63 - __builtin_clzll(v);
+    const int sub = (int)((v >> (e - SubBucketBits)) & (SubBuckets - 1));
+    return (e - SubBucketBits + 1) * SubBuckets + sub;
+  }
+
+  /// Largest value that falls in bucket @a i.
+  static uint64_t bucketUpperBound(int i)
+  {
+    if(i < SubBuckets)
+      return (uint64_t)i;
+    const int e = i / SubBuckets + SubBucketBits - 1;
+    const uint64_t sub = (uint64_t)(i % SubBuckets);
+    return ((SubBuckets + sub + 1) << (e - SubBucketBits)) - 1;
+  }
+
+protected:
+  std::string name;
+  std::atomic<uint64_t> buckets[NumBuckets];
+  std::atomic<uint64_t> max_ns;
+};
+
+/**
+ * Records the time from construction to destruction into a LatencyHistogram.
+ */
+class LatencyScope
+{
+public:
+  LatencyScope(LatencyHistogram& _h) : h(_h), start(std::chrono::steady_clock::now()) {}
+  ~LatencyScope()
+  {
+    h.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+  }
+private:
+  LatencyHistogram& h;
+  std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * Process-wide list of live LatencyHistograms, so that histograms can be
+ * declared next to the code they measure (in LaserPublisher, RobotMonitor,
+ * etc.) and still be reported from one place.
+ */
+class LatencyRegistry
+{
+public:
+  static LatencyRegistry& instance();
+
+  void add(LatencyHistogram *h);
+  void remove(LatencyHistogram *h);
+
+  /// Call @a f for each registered histogram, with the registry locked.
+  template<class F> void forEach(F f)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for(size_t i = 0; i < histograms.size(); ++i)
+      f(*histograms[i]);
+  }
+
+private:
+  std::mutex mutex;
+  std::vector<LatencyHistogram*> histograms;
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef _ROSARNL_MERGEDSCANPUBLISHER_H_
+#define _ROSARNL_MERGEDSCANPUBLISHER_H_
+
+#include <ros/ros.h>
+#include <boost/function.hpp>
+#include <sensor_msgs/LaserScan.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include "ariaUtil.h"
+#include "AllocationCheck.h"
+#include "LatencyHistogram.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Merges the scans of all lasers into one 360 degree LaserScan
+ * ("merged_scan") and PointCloud2 ("merged_cloud") in the robot base frame,
+ * so that consumers don't need their own laser merger and tf lookups.
+ *
+ * Each LaserPublisher transforms its own readings into the base frame in its
+ * publishing thread, so the lasers are transformed in parallel, and passes
+ * the points to addScan(). Once every laser has contributed a scan within
+ * merge_window of the others, the set is handed over to the thread that
+ * completed it, which builds and publishes the merged messages without
+ * holding up the other lasers. A laser's scan that is older than that is
+ * dropped and replaced by its next one.
+ */
+class MergedScanPublisher
+{
+public:
+  MergedScanPublisher(ros::NodeHandle& n, const std::string& base_frame, double merge_window, double resolution_deg);
+
+  /**
+   * Register a laser with up to @a max_points readings per scan, reaching
+   * @a max_range (m) from the base frame origin.
+   * @return its index for addScan().
+   */
+  size_t addLaser(const std::string& name, double max_range, size_t max_points);
+
+  /// True if either merged topic has subscribers.
+  bool wanted() const;
+
+  /// Register a callback called when a merged topic gains or loses a subscriber.
+  void addSubscriberChangeCB(const boost::function<void()>& cb);
+
+  /**
+   * Add one scan of laser @a index. @a xy holds @a npoints x, y pairs in the
+   * base frame (m), @a z is the height of the laser. Called from that
+   * laser's publishing thread.
+   */
+  void addScan(size_t index, const ArTime& time, const float *xy, size_t npoints, float z);
+
+protected:
+  struct Slot
+  {
+    bool valid;
+    ArTime time;
+    float z;
+    std::vector<float> xy;
+  };
+
+  /// Build and publish the merged messages from merge_set. Caller holds
+  /// publish_mutex.
+  void publishMerged();
+  void subscribersChanged(const ros::SingleSubscriberPublisher&);
+
+  ros::Publisher scan_pub, cloud_pub;
+  sensor_msgs::LaserScan scan;
+  sensor_msgs::PointCloud2 cloud;
+  long merge_window_ms;
+
+  std::mutex mutex;  ///< slots and subscriber_change_cbs
+  std::vector<Slot> slots;
+
+  /// Held while building and publishing merge_set, scan and cloud. Lock
+  /// order is mutex, then publish_mutex.
+  std::mutex publish_mutex;
+  std::vector<Slot> merge_set;
+  std::vector< boost::function<void()> > subscriber_change_cbs;
+
+  AllocationCheck alloc_check{"merged scan"};
+  LatencyHistogram latency{"merged scan"};
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef _ROSARNL_POSEEXTRAPOLATOR_H_
+#define _ROSARNL_POSEEXTRAPOLATOR_H_
+
+#include "PoseHistory.h"
+
+/**
+ * Map frame robot pose at any recent instant, for consumers (path following
+ * controllers) that need it faster or at different times than robot cycles.
+ *
+ * Each robot cycle adds a sample: ArRobot's pose, which is ARNL's last
+ * localization carried forward by the odometry deltas since, with the
+ * velocities from the same SIP. poseAt() interpolates between samples inside
+ * the history, and beyond the newest one integrates its velocities (constant
+ * body frame twist) for at most max_extrapolation seconds.
+ *
+ * Samples are added by the ArRobot sensor interpretation task; poseAt() may
+ * be called from any thread and never blocks it (see PoseHistory).
+ */
+class PoseExtrapolator
+{
+public:
+  void addSample(const PoseSample& s);
+
+  /**
+   * Pose at ROS time @a t (sec).
+   * @return false if @a t is older than the history, or more than
+   * @a max_extrapolation sec after the newest sample.
+   */
+  bool poseAt(double t, double max_extrapolation, PoseSample& out) const;
+
+  /// Move @a s forward by @a dt sec at its own velocities.
+  static PoseSample extrapolate(const PoseSample& s, double dt);
+
+  const PoseHistory& getHistory() const { return history; }
+
+private:
+  PoseHistory history;
+};
+
+#endif
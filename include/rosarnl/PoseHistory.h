@@ -0,0 +1,77 @@
+#ifndef _ROSARNL_POSEHISTORY_H_
+#define _ROSARNL_POSEHISTORY_H_
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * Robot pose and velocity at one instant, in ROS units: ROS time (sec),
+ * map frame position (m) and heading (rad), and base frame velocities
+ * (m/sec, rad/sec).
+ */
+struct PoseSample
+{
+  double t;
+  double x, y, th;
+  double vx, vy, wz;
+
+  PoseSample() : t(0), x(0), y(0), th(0), vx(0), vy(0), wz(0) {}
+};
+
+/**
+ * Fixed capacity, lock-free ring of the most recent PoseSamples, in time
+ * order. Storage is part of the object, so add() never allocates or blocks;
+ * once full the oldest sample is overwritten.
+ *
+ * There must be only one writer (the ArRobot sensor interpretation task).
+ * Any number of threads may read. Each slot is a sequence lock (see
+ * CmdVelMailbox) and also records which sample number it holds, so a reader
+ * can tell a torn read from a slot that was overwritten while it searched.
+ * interpolate() finds the bracketing pair by binary search, which is at most
+ * log2(Capacity) slot reads. Clearing only moves the first sample number
+ * forward, so sample numbers keep increasing and these checks still hold.
+ */
+class PoseHistory
+{
+public:
+  enum { Capacity = 256 };
+
+  PoseHistory();
+
+  /// Append a sample. A sample at the same time as the newest one is
+  /// ignored; one before it means ROS time went backwards (a simulation
+  /// restart or a clock step), and the history is cleared first.
+  /// Writer thread only.
+  void add(const PoseSample& s);
+
+  /// @return false if empty.
+  bool latest(PoseSample& out) const;
+
+  /**
+   * Interpolate the pose at time @a t.
+   * @return false if @a t is outside the span of the history.
+   */
+  bool interpolate(double t, PoseSample& out) const;
+
+private:
+  struct Slot
+  {
+    std::atomic<unsigned long> seq;
+    std::atomic<size_t> n;  // sample number held
+    std::atomic<double> t, x, y, th, vx, vy, wz;
+  };
+
+  /// Copy sample number @a n. Returns false if it has been overwritten.
+  bool read(size_t n, PoseSample& out) const;
+
+  /// One attempt at interpolate(). Sets @a retry if a slot was overwritten
+  /// during the search.
+  bool tryInterpolate(double t, PoseSample& out, bool& retry) const;
+
+  Slot slots[Capacity];
+  std::atomic<size_t> written;  // number of samples ever added
+  std::atomic<size_t> first;    // sample number of the oldest since the last clear
+  double newest_t;              // writer only
+};
+
+#endif
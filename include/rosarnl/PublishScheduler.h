@@ -0,0 +1,89 @@
+#ifndef _ROSARNL_PUBLISHSCHEDULER_H_
+#define _ROSARNL_PUBLISHSCHEDULER_H_
+
+#include <boost/function.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Runs periodic publishing functions ("streams"), each at its own rate, from
+ * a single thread. Pending deadlines are kept in a min-heap so that the
+ * owning thread only has to look at the earliest one to know how long it may
+ * sleep.
+ *
+ * Each stream is emitted exactly once per period. If the thread falls behind
+ * by more than a period, the missed periods are skipped (and counted) rather
+ * than emitted in a burst.
+ *
+ * Streams must all be added before the owning thread first calls runDue().
+ * setRate() may be called from any thread.
+ */
+class PublishScheduler
+{
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  PublishScheduler();
+
+  /**
+   * Add a stream. A rate of zero or less disables the stream until it is
+   * changed with setRate().
+   * @return id for use with setRate().
+   */
+  int addStream(const std::string& name, double rate, const boost::function<void()>& fn);
+
+  /**
+   * Change the rate of a stream (Hz). The next runDue() moves the stream's
+   * pending deadline to one new period after its last emission (or to now,
+   * if that has already passed), so a shorter period applies right away
+   * rather than after the deadline computed from the old one.
+   */
+  void setRate(int id, double rate);
+
+  /**
+   * Run every stream whose deadline is at or before @a now.
+   * @return The earliest pending deadline after running.
+   */
+  Clock::time_point runDue(Clock::time_point now);
+
+  /// Number of periods skipped because a stream was emitted late.
+  unsigned long getMissed(int id) const { return streams[id]->missed; }
+  const std::string& getName(int id) const { return streams[id]->name; }
+  size_t size() const { return streams.size(); }
+
+protected:
+  struct Stream
+  {
+    std::string name;
+    boost::function<void()> fn;
+    std::atomic<long long> period_ns; // <= 0 means disabled
+    std::atomic<bool> rate_changed;   // set by setRate(), cleared by runDue()
+    Clock::time_point last_run;       // valid once emitted > 0
+    unsigned long emitted;
+    unsigned long missed;
+  };
+
+  struct Deadline
+  {
+    Clock::time_point when;
+    int id;
+    bool operator>(const Deadline& other) const { return when > other.when; }
+  };
+
+  static long long rateToPeriod(double rate);
+
+  /// Reschedule the pending deadlines of streams whose rate has changed.
+  void applyRateChanges(Clock::time_point now);
+
+  // Streams are not copyable (atomic member), so keep them by pointer.
+  std::vector< std::unique_ptr<Stream> > streams;
+  std::vector<Deadline> heap;
+  bool started;
+  std::atomic<bool> rates_changed;  // any stream's rate_changed is set
+};
+
+#endif
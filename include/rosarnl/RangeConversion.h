@@ -0,0 +1,53 @@
+#ifndef _ROSARNL_RANGECONVERSION_H_
+#define _ROSARNL_RANGECONVERSION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Number of 32 bit words needed for an ignore bitmask of @a n readings.
+inline size_t rangeIgnoreMaskWords(size_t n) { return (n + 31) / 32; }
+
+/// Set or clear bit @a i of an ignore bitmask.
+inline void setRangeIgnored(uint32_t *ignore_mask, size_t i, bool ignored)
+{
+  ignore_mask[i >> 5] |= (uint32_t)ignored << (i & 31);
+}
+
+/**
+ * Convert @a n raw laser ranges to LaserScan ranges in one pass.
+ *
+ * @param mm          ranges in mm, in the order the laser reported them
+ * @param ignore_mask bit i%32 of word i/32 is set if reading i is ignored
+ * @param flipped     reverse the order of the output (laser mounted upside down)
+ * @param range_min,range_max  valid ranges are clamped to this interval (m)
+ * @param out         n output ranges (m); ignored readings are set to -1
+ *
+ * The input is plain arrays rather than ARIA's list of ArSensorReading so
+ * that the loop has no pointer chasing and no branches, and the compiler
+ * vectorizes it (SSE2 on x86-64, NEON on ARM) without target specific code.
+ * That needs the loop vectorizer, so CMakeLists.txt builds RangeConversion.cpp
+ * with -O3 (check with -fopt-info-vec).
+ */
+void convertRanges(const uint32_t *mm, const uint32_t *ignore_mask, size_t n, bool flipped, float range_min, float range_max, float *out);
+
+/// Upper bound on the size of encodeCompactRanges() output for @a n ranges.
+inline size_t compactRangesMaxBytes(size_t n) { return 3 * n; }
+
+/**
+ * Encode @a n LaserScan ranges (m) into the delta encoded uint16 mm format
+ * of the CompactScan message, writing at most compactRangesMaxBytes(n) bytes
+ * to @a out. Ranges that are not positive (ignored or cropped readings) are
+ * encoded as RANGE_NONE (0).
+ * @return number of bytes written
+ */
+size_t encodeCompactRanges(const float *ranges, size_t n, uint8_t *out);
+
+/**
+ * Decode @a count ranges in mm from @a bytes of CompactScan data. The node
+ * only encodes; this is the reference decoder for subscribers written in
+ * C++, and is checked against encodeCompactRanges() by the unit tests.
+ * @return false if the data is truncated or malformed.
+ */
+bool decodeCompactRanges(const uint8_t *data, size_t bytes, size_t count, uint16_t *mm);
+
+#endif
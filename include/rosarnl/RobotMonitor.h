@@ -3,6 +3,7 @@
 
 #include "Aria/Aria.h"
 #include "ArNetworking/ArNetworking.h"
+#include "LatencyHistogram.h"
 
 class RobotMonitor {
 protected:
@@ -27,6 +28,7 @@ protected:
   void robotMonitorTask();
   
   bool wheelLightDefault;
+  LatencyHistogram taskLatency;
 };
 
 #endif
@@ -0,0 +1,65 @@
+#ifndef _ROSARNL_ROBOTSTATENOTIFIER_H_
+#define _ROSARNL_ROBOTSTATENOTIFIER_H_
+
+#include "RobotStateSnapshot.h"
+
+#include <boost/function.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+/**
+ * Detects transitions in discrete robot state (motors enabled, e-stop, dock
+ * state, charge state) and lets other threads wait for them instead of
+ * polling ArRobot.
+ *
+ * update() is called from the ArRobot sensor interpretation task with each
+ * new snapshot. It only compares against the previous state, which costs
+ * nothing on most cycles; only when something changed does it take the
+ * mutex, record the new state and wake waiters.
+ */
+class RobotStateNotifier
+{
+public:
+  enum Change {
+    MotorsChanged = 1,
+    EStopChanged = 2,
+    DockStateChanged = 4,
+    ChargeStateChanged = 8
+  };
+
+  RobotStateNotifier();
+
+  /// Called only from the ArRobot thread.
+  void update(const RobotStateSnapshot& snap);
+
+  /**
+   * Block until @a pred returns true for the current state or @a timeout
+   * (sec) passes. @a pred is evaluated immediately, then after each change.
+   * @return the last value of @a pred.
+   */
+  bool waitFor(const boost::function<bool(const RobotStateSnapshot&)>& pred, double timeout);
+
+  /// Copy of the state as of the most recent change.
+  RobotStateSnapshot getState() const;
+
+  /**
+   * Return the Change bits accumulated since the last call and clear them.
+   * Meant for a single consumer (the publishing thread). The first call after
+   * the first update() reports every bit as changed.
+   */
+  unsigned int takeChanges() { return pending_changes.exchange(0); }
+
+protected:
+  // Only used by update(), i.e. the robot thread
+  RobotStateSnapshot last;
+  bool have_last;
+
+  mutable std::mutex mutex;
+  std::condition_variable cond;
+  RobotStateSnapshot state;
+  std::atomic<unsigned int> pending_changes;
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef _ROSARNL_ROBOTSTATESNAPSHOT_H_
+#define _ROSARNL_ROBOTSTATESNAPSHOT_H_
+
+#include "ariaUtil.h"
+
+/**
+ * Compact copy of the robot state taken once per ArRobot cycle from the
+ * sensor interpretation task. Everything the ROS publishing thread needs is
+ * copied in here so that it never has to touch ArRobot while building
+ * messages. Units are ARIA units (mm, deg, mm/sec, deg/sec).
+ */
+struct RobotStateSnapshot
+{
+  ArTime time;          ///< When the snapshot was taken (ARIA clock)
+  ArTime packetTime;    ///< When the SIP the pose and velocities came from was received (ARIA clock)
+  double x, y, th;      ///< Localized pose (mm, mm, deg)
+  double encX, encY, encTh; ///< Raw encoder (odometry) pose (mm, mm, deg)
+  double vel;           ///< Translational velocity (mm/sec)
+  double rotVel;        ///< Rotational velocity (deg/sec)
+  double latVel;        ///< Lateral velocity (mm/sec)
+  bool motorsEnabled;
+  bool estop;
+  double stateOfCharge; ///< Battery state of charge (percent)
+  int chargeState;      ///< ArRobot::ChargeState
+  int dockState;        ///< ArServerModeDock::State, or -1 if no dock mode
+  int pathState;        ///< ArPathPlanningTask::PathPlanningState
+  char serverMode[256];     ///< Active ArServerMode mode string, "" if none
+  char serverStatus[1024];  ///< Active ArServerMode status string, "" if none
+
+  RobotStateSnapshot() :
+    x(0), y(0), th(0), encX(0), encY(0), encTh(0), vel(0), rotVel(0), latVel(0),
+    motorsEnabled(false), estop(false),
+    stateOfCharge(0), chargeState(-1), dockState(-1), pathState(-1)
+  {
+    serverMode[0] = '\0';
+    serverStatus[0] = '\0';
+  }
+};
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef _ROSARNL_ROSARNLCONFIG_H_
+#define _ROSARNL_ROSARNLCONFIG_H_
+
+#include <ros/ros.h>
+#include <std_srvs/Empty.h>
+#include <boost/function.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * rosarnl_node parameters, read from the parameter server (private
+ * namespace) once at startup and again whenever a reload is requested.
+ * Instances are immutable once published through RosArnlConfigStore.
+ */
+struct RosArnlConfig
+{
+  // Localization
+  bool use_covariance;
+  double covariance_rate;   // Hz
+
+  // Publishing rates (Hz)
+  double pose_rate;
+  double tf_rate;
+  double feedback_rate;
+  double state_rate;
+  double extrapolated_pose_rate;
+
+  // Longest time past the newest robot cycle that poses are extrapolated (sec)
+  double pose_extrapolation_limit;
+
+  // How far the map->odom transform is post-dated (sec)
+  double transform_tolerance;
+
+  // Number of threads serving each callback queue
+  int motion_threads;
+  int action_threads;
+  int admin_threads;
+  int diagnostics_threads;
+
+  // Battery status publishing period (sec)
+  double battery_period;
+
+  // Stop the robot if no cmd_vel message arrives for this long after the last
+  // one (sec). 0 disables.
+  double cmd_vel_timeout;
+
+  // Rate for publishing latency statistics on /diagnostics (Hz)
+  double diagnostics_rate;
+
+  // Rate for re-estimating the ARIA to ROS clock mapping (Hz)
+  double clock_sync_rate;
+
+  // Merged scan of all lasers in the base frame (startup only)
+  bool merged_scan;
+  double merged_scan_window;      // sec
+  double merged_scan_resolution;  // deg
+
+  // Publish fewer laser scans while wireless link quality is below
+  // link_quality_full_rate (0 disables), skipping at most max_scan_skip
+  int link_quality_full_rate;
+  int max_scan_skip;
+
+  // Send a full keyframe every this many <laser>_cumulative_delta messages
+  int cumulative_keyframe_interval;
+
+  // Frame names, already resolved with tf_prefix
+  std::string tf_prefix;
+  std::string frame_id_map;
+  std::string frame_id_odom;
+  std::string frame_id_base_link;
+  std::string frame_id_bumper;
+  std::string frame_id_sonar;
+
+  /// Read all parameters from @a n, using defaults for any not set, and
+  /// validate them.
+  static RosArnlConfig load(ros::NodeHandle& n);
+
+  /// Read parameters without validating. tf_prefix is taken from
+  /// @a previous if given, otherwise looked up.
+  static RosArnlConfig read(ros::NodeHandle& n, const RosArnlConfig *previous);
+
+  /// Replace invalid values with defaults, with a warning.
+  void validate();
+
+  bool operator==(const RosArnlConfig& o) const;
+  bool sameFrames(const RosArnlConfig& o) const;
+};
+
+/**
+ * Holds the current RosArnlConfig behind an atomic pointer so that the
+ * publishing thread, ArRobot tasks and ROS callbacks can read it without
+ * locking and without ever contacting the parameter server.
+ *
+ * Parameters are read through roscpp's parameter cache, so the master
+ * notifies the node when one is changed (e.g. with "rosparam set"). The
+ * cached values are checked once a second and the config is reloaded when
+ * any of them changed; the "reload_params" service reloads immediately.
+ * Frame names are fixed at startup; changes to them are refused with a
+ * warning. A reload builds a new config object and swaps it in. The old
+ * object is freed retire_grace after it was replaced, so a reader holding a
+ * reference from get() for a single callback or cycle never sees it freed,
+ * while memory stays bounded however often parameters change. Readers must
+ * not keep such a reference across a blocking call; copy what they need.
+ * This keeps the read path a single atomic load, with no reference counting.
+ */
+class RosArnlConfigStore
+{
+public:
+  RosArnlConfigStore(ros::NodeHandle& _n);
+
+  /// Current config. Lock free; safe to call from any thread.
+  const RosArnlConfig& get() const { return *current.load(std::memory_order_acquire); }
+
+  /// Re-read parameters and publish a new config, then call change callbacks.
+  void reload();
+
+  /// reload() if any parameter differs from the last read.
+  void reloadIfChanged();
+
+  /// Register a callback called (from the reloading thread) after each reload.
+  void addChangeCB(const boost::function<void(const RosArnlConfig&)>& cb);
+
+protected:
+  bool reload_cb(std_srvs::Empty::Request& request, std_srvs::Empty::Response& response);
+  void check_cb(const ros::TimerEvent& event);
+
+  /// Validate @a c, keep the current frames, swap it in and call change
+  /// callbacks. Called with reload_mutex held.
+  void publish(RosArnlConfig c);
+
+  ros::NodeHandle& node;
+  std::atomic<const RosArnlConfig*> current;
+  std::mutex reload_mutex;
+
+  /// How long a replaced config is kept before it is freed (sec)
+  static constexpr double retire_grace = 10.0;
+  struct Retired
+  {
+    std::chrono::steady_clock::time_point since;
+    std::unique_ptr<const RosArnlConfig> config;
+  };
+  std::unique_ptr<const RosArnlConfig> current_version;  // what current points to
+  std::deque<Retired> retired;  // oldest first
+  std::vector< boost::function<void(const RosArnlConfig&)> > change_cbs;
+  ros::ServiceServer reload_srv;
+  ros::Timer check_timer;
+  RosArnlConfig last_read;  // unvalidated, to detect changes
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef _ROSARNL_SCANTIMEESTIMATOR_H_
+#define _ROSARNL_SCANTIMEESTIMATOR_H_
+
+#include <cstddef>
+
+/**
+ * Estimate of a laser's scan period from the reading times of consecutive
+ * scans, used for LaserScan scan_time and time_increment.
+ *
+ * The interval between stamps is low pass filtered. Intervals much longer
+ * than the estimate are dropped scans (or a pause), not a change of rate, and
+ * are ignored, unless several arrive in a row, in which case the rate really
+ * has changed and the estimate restarts from the latest interval. Stamps that
+ * do not advance are ignored.
+ */
+class ScanTimeEstimator
+{
+public:
+  ScanTimeEstimator();
+
+  /// Forget all stamps; get() returns 0 until two more have been added.
+  void reset();
+
+  /// Add the reading time of a scan, in seconds on any monotonic clock.
+  void addStamp(double t);
+
+  /// Scan period (sec), 0 until known.
+  double get() const { return estimate; }
+
+private:
+  double last_t;
+  bool have_last_t;
+  double estimate;
+  size_t rejected;  ///< consecutive long intervals ignored
+};
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef _ROSARNL_SONARPUBLISHER_H_
+#define _ROSARNL_SONARPUBLISHER_H_
+
+#include <ros/ros.h>
+#include <sensor_msgs/Range.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <tf2_ros/static_transform_broadcaster.h>
+
+#include "ariaUtil.h"
+#include "AllocationCheck.h"
+#include "LatencyHistogram.h"
+#include "TripleBuffer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ArRobot;
+
+/**
+ * Publishes the robot's sonar as a sensor_msgs/Range message per transducer
+ * ("sonar_<n>", in frame "<sonar_frame>_<n>") and a PointCloud2 of all
+ * transducers' latest echoes ("sonar_cloud", in the base frame).
+ *
+ * The transducer positions (base frame to "<sonar_frame>_<n>") are published
+ * once on /tf_static.
+ *
+ * A sensor interpretation task copies the readings from each SIP into a
+ * SonarCapture, but only while sonar is enabled (so not while
+ * ArSonarAutoDisabler has turned it off) and only if some transducer was
+ * updated by that SIP. A separate thread publishes the transducers that were
+ * updated since it last published, so the robot thread never builds or
+ * serializes messages.
+ */
+class SonarPublisher
+{
+public:
+  SonarPublisher(ArRobot *_robot, ros::NodeHandle& _n, tf2_ros::StaticTransformBroadcaster& _static_tf, const std::string& _base_frame, const std::string& _sonar_frame);
+  ~SonarPublisher();
+
+protected:
+  enum { MaxSonar = 32 };
+
+  /// Sonar readings from one SIP
+  struct SonarCapture
+  {
+    ArTime time;
+    int count;
+    bool updated[MaxSonar];
+    float range[MaxSonar];  ///< m
+    float x[MaxSonar], y[MaxSonar];  ///< reading position in base frame (m)
+  };
+
+  void sonarTask();
+  void publishThreadMain();
+  void publish(const SonarCapture& c);
+
+  ArRobot *robot;
+  ArFunctorC<SonarPublisher> sonarTaskCB;
+  int num_sonar;
+  float max_range;  ///< m, readings at or beyond this are no echo
+
+  /// From sonarTask() to the publishing thread. If that thread falls
+  /// behind, a capture replaces the one not taken yet and inherits its
+  /// updated flags (every capture has all transducers' latest ranges).
+  TripleBuffer<SonarCapture> captures;
+  bool carry_updated;  ///< sonarTask() only: captures.back() was never published
+  std::mutex capture_mutex;
+  std::condition_variable capture_cond;
+  std::atomic<bool> publish_thread_running;
+  std::thread publish_thread;
+
+  std::vector<ros::Publisher> range_pubs;
+  std::vector<sensor_msgs::Range> range_msgs;
+  std::string base_frame;
+  ros::Publisher cloud_pub;
+  sensor_msgs::PointCloud2 cloud;
+
+  AllocationCheck alloc_check{"sonar"};
+  LatencyHistogram task_latency{"sonarTask"};
+  LatencyHistogram publish_latency{"sonar publish"};
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _ROSARNL_STATEMESSAGES_H_
+#define _ROSARNL_STATEMESSAGES_H_
+
+#include <geometry_msgs/Pose.h>
+#include <geometry_msgs/Transform.h>
+#include <nav_msgs/Odometry.h>
+#include <std_msgs/String.h>
+
+#include "RobotStateSnapshot.h"
+
+/*
+ * Message bodies built from a RobotStateSnapshot, converted from ARIA units
+ * (mm, deg) to ROS units (m, rad). These are the steady-state message
+ * building steps of the publishing thread; they only write into the given
+ * messages, so with messages that are reused they never allocate. Headers
+ * (stamp, frames) are left to the caller.
+ */
+
+/// Localized pose
+void fillPose(const RobotStateSnapshot& snap, geometry_msgs::Pose& pose);
+
+/// map->odom: the correction from the raw encoder pose to the localized
+/// pose, both taken in the same robot cycle.
+void fillMapToOdom(const RobotStateSnapshot& snap, geometry_msgs::Transform& map_odom);
+
+/// odom->base_link from the raw encoder pose, and odometry with the same
+/// pose in the odom frame and the velocities in the robot frame.
+void fillOdometry(const RobotStateSnapshot& snap, geometry_msgs::Transform& odom_base, nav_msgs::Odometry& odom);
+
+/**
+ * Copy server state string @a s into @a msg, if it is not empty and differs
+ * from what @a msg holds. Strings reserved at startup with enough capacity
+ * for the snapshot fields are never reallocated.
+ * @return true if @a msg changed.
+ */
+bool updateStateString(const char *s, std_msgs::String& msg);
+
+#endif
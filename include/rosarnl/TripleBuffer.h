@@ -0,0 +1,79 @@
+#ifndef _ROSARNL_TRIPLEBUFFER_H_
+#define _ROSARNL_TRIPLEBUFFER_H_
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * Lock-free "latest value" hand-off from exactly one producer thread to one
+ * consumer thread, for values too big for the atomic fields of a sequence
+ * lock (see CmdVelMailbox).
+ *
+ * There are three buffers: the producer fills back(), the consumer reads
+ * front(), and the third holds the latest published value. publish() and
+ * take() each swap their own buffer with the middle one by a single atomic
+ * exchange, so neither side ever blocks or waits for the other, and a new
+ * value always replaces an old one that was not taken yet. The consumer
+ * therefore always gets the newest value however far it falls behind.
+ *
+ * Storage is part of the object, so nothing allocates after construction.
+ */
+template<class T>
+class TripleBuffer
+{
+public:
+  TripleBuffer() : back_index(0), middle(1), overwritten(0), front_index(2) {}
+
+  /// Producer only: the buffer to fill before publish(). It holds whatever
+  /// was left in it, not necessarily the last value written.
+  T& back() { return buffers[back_index]; }
+
+  /**
+   * Producer only: make back() the latest value.
+   * @return false if the previous value was replaced before the consumer
+   * took it. back() then holds that value, e.g. to carry part of it over.
+   */
+  bool publish()
+  {
+    const unsigned prev = middle.exchange(back_index | Fresh, std::memory_order_acq_rel);
+    back_index = prev & IndexMask;
+    if(prev & Fresh)
+    {
+      overwritten.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    return true;
+  }
+
+  /// True if a value has been published since the consumer last took one.
+  bool fresh() const { return middle.load(std::memory_order_acquire) & Fresh; }
+
+  /// Consumer only: if there is a new value, make it front().
+  /// @return false if nothing was published since the last take().
+  bool take()
+  {
+    if(!(middle.load(std::memory_order_relaxed) & Fresh))
+      return false;
+    const unsigned prev = middle.exchange(front_index, std::memory_order_acq_rel);
+    front_index = prev & IndexMask;
+    return true;
+  }
+
+  /// Consumer only: the value from the last successful take().
+  const T& front() const { return buffers[front_index]; }
+
+  /// Number of values replaced before the consumer took them.
+  size_t getOverwritten() const { return overwritten.load(std::memory_order_relaxed); }
+
+private:
+  enum { IndexMask = 3, Fresh = 4 };
+
+  T buffers[3];
+  unsigned back_index;  // producer only
+  // middle buffer index, plus Fresh while it holds a value not yet taken
+  alignas(64) std::atomic<unsigned> middle;
+  std::atomic<size_t> overwritten;
+  alignas(64) unsigned front_index;  // consumer only
+};
+
+#endif
@@ -9,12 +9,26 @@
 #include "ArnlSystem.h"
 
 #include "LaserPublisher.h"
+#include "SonarPublisher.h"
+#include "RosArnlConfig.h"
+#include "CovarianceWorker.h"
+#include "PublishScheduler.h"
+#include "AllocationCheck.h"
+#include "CmdVelMailbox.h"
+#include "RobotStateNotifier.h"
+#include "LatencyHistogram.h"
+#include "ClockMapping.h"
+#include "RobotStateSnapshot.h"
+#include "TripleBuffer.h"
+#include "PoseExtrapolator.h"
 #include <rosarnl/BatteryStatus.h>
 #include <rosarnl/WheelLight.h>
 #include <rosarnl/ChangeMap.h>
 #include <rosarnl/Stop.h>
+#include <rosarnl/GetPoses.h>
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <geometry_msgs/Twist.h>
 #include <geometry_msgs/Pose.h>
 #include <geometry_msgs/PoseStamped.h>
@@ -24,9 +38,12 @@
 #include <nav_msgs/GetPlan.h>
 #include <nav_msgs/Odometry.h>
 #include <tf/tf.h>
-#include <tf/transform_listener.h>
-#include <tf/transform_broadcaster.h>
 #include <tf/transform_datatypes.h>
+#include <tf2_ros/buffer.h>
+#include <tf2_ros/transform_listener.h>
+#include <tf2_ros/static_transform_broadcaster.h>
+#include <tf2_msgs/TFMessage.h>
+#include <tf2_geometry_msgs/tf2_geometry_msgs.h>
 #include <std_msgs/Bool.h>
 #include <std_msgs/String.h>
 #include <std_msgs/Float64.h>
@@ -36,6 +53,13 @@
 #include <std_srvs/Empty.h>
 #include <actionlib/server/simple_action_server.h>
 #include <move_base_msgs/MoveBaseAction.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 // Speech synthesis. Requires optional build parameter ROSARNL_SPEECH
 #ifdef ROSARNL_SPEECH
@@ -62,17 +86,141 @@ public:
    * @breif Begin the main operating loop.
    */
   void spin();
+
+  /// Current parameters.
+  const RosArnlConfig& getConfig() const { return config.get(); }
+
+  /// Broadcaster for all of the node's fixed transforms (sensor mounts).
+  tf2_ros::StaticTransformBroadcaster& getStaticTransformBroadcaster() { return static_tf; }
+
+  /// Map frame pose at recent ROS times, interpolated or extrapolated from
+  /// the robot cycles. Lock free; safe to use from any thread.
+  const PoseExtrapolator& getPoseExtrapolator() const { return pose_extrapolator; }
   
-  /**
-   * @breif Update the published topics.
-   */
-  void publish();
 
 protected:
   ros::NodeHandle n;
   ArnlSystem &arnl;
+
+  // Callback queues, each served by its own AsyncSpinner (started in
+  // Setup()) with the number of threads given in the config:
+  //  motion: cmd_vel, initialpose, move_base_simple/goal, goalname, get_poses
+  //  action: move_base action server
+  //  admin: services (motors, dock, wander, change_map, global_localization, get_plan etc.)
+  //  diagnostics: reload_params, /shutdown
+  ros::CallbackQueue motion_queue;
+  ros::CallbackQueue action_queue;
+  ros::CallbackQueue admin_queue;
+  ros::CallbackQueue diagnostics_queue;
+  ros::NodeHandle motion_nh;
+  ros::NodeHandle action_nh;
+  ros::NodeHandle admin_nh;
+  ros::NodeHandle diagnostics_nh;
+  std::unique_ptr<ros::AsyncSpinner> motion_spinner;
+  std::unique_ptr<ros::AsyncSpinner> action_spinner;
+  std::unique_ptr<ros::AsyncSpinner> admin_spinner;
+  std::unique_ptr<ros::AsyncSpinner> diagnostics_spinner;
+  void stopSpinners();
+
+  // Node parameters. Read config.get() instead of calling n.getParam().
+  RosArnlConfigStore config;
+
+  // Localization covariance for amcl_pose, computed off the robot thread
+  CovarianceWorker covariance_worker;
   
-  ArFunctorC<RosArnlNode> myPublishCB;
+  /**
+   * @brief Copy the robot state into the snapshot buffer. Called via
+   * SensorInterpTask callback (mySnapshotCB, named "ROSSnapshotTask") on
+   * every robot cycle, so it must stay cheap: no ROS calls, no allocation.
+   */
+  void captureSnapshot();
+  ArFunctorC<RosArnlNode> mySnapshotCB;
+
+  // Snapshots flow from the ArRobot thread (single producer) to the
+  // publishing thread (single consumer), newest replacing any not yet taken.
+  TripleBuffer<RobotStateSnapshot> snapshot_buffer;
+  std::mutex snapshot_mutex;
+  std::condition_variable snapshot_cond;
+
+  /**
+   * @brief Publishing thread main loop. Takes the newest snapshot and runs the
+   * publish scheduler, which does all ROS message building and serialization.
+   */
+  void publishThreadMain();
+  std::thread publish_thread;
+  std::atomic<bool> publish_thread_running;
+
+  // Most recent snapshot. Only used by the publishing thread.
+  RobotStateSnapshot latest_snapshot;
+
+  // Periodic publishers, each run at its configured rate by the publishing
+  // thread from latest_snapshot.
+  PublishScheduler scheduler;
+  int stream_pose;
+  int stream_tf;
+  int stream_feedback;
+  int stream_battery;
+  int stream_state;
+  int stream_extrapolated_pose;
+  void setupPublishScheduler(const RosArnlConfig& cfg);
+  void updatePublishRates(const RosArnlConfig& cfg);
+
+  /// amcl_pose (pose_rate)
+  void publishPose();
+  /// Attach the latest localization covariance, if enabled, to @a pose
+  void fillCovariance(geometry_msgs::PoseWithCovariance& pose);
+  /// map to odom transform (tf_rate)
+  void publishTransform();
+  /// odom topic and odom to base_link transform, for every new snapshot
+  void publishOdometry();
+  /// extrapolated_pose (extrapolated_pose_rate)
+  void publishExtrapolatedPose();
+
+  // Recent map frame poses, added by captureSnapshot() every robot cycle
+  PoseExtrapolator pose_extrapolator;
+
+  /// Poses at a batch of times from pose_extrapolator
+  bool get_poses_cb(rosarnl::GetPoses::Request& request, rosarnl::GetPoses::Response& response);
+  ros::ServiceServer get_poses_srv;
+  /// move_base action feedback while executing a goal (feedback_rate)
+  void publishFeedback();
+  /// battery_status (1/battery_period)
+  void publishBattery();
+  /// arnl_server_status and arnl_server_mode, each only when changed (state_rate)
+  void publishStateTopics();
+
+  // Motors, e-stop, dock and charge state transitions, detected in
+  // captureSnapshot(). Services wait on this instead of polling ArRobot.
+  RobotStateNotifier state_notifier;
+
+  /// motors_state, dock_state and battery_status, published as soon as the
+  /// publishing thread sees a change from state_notifier.
+  void publishStateChanges(unsigned int changes);
+
+  // Latency of the hot paths. All LatencyHistograms (including those in
+  // LaserPublisher and RobotMonitor) are summarized on /diagnostics by
+  // publishDiagnostics() at diagnostics_rate.
+  LatencyHistogram publish_latency{"publish"};
+  LatencyHistogram cmd_vel_cb_latency{"cmdvel_cb"};
+  LatencyHistogram cmd_vel_apply_latency{"cmd_vel receipt to setVel"};
+  LatencyHistogram get_plan_latency{"get_plan_cb"};
+  LatencyHistogram action_loop_latency{"move_base action loop"};
+  ros::Publisher diagnostics_pub;
+  int stream_diagnostics;
+  void publishDiagnostics();
+
+  // Re-estimates the ArTime to ROS time mapping used for all ARIA stamps
+  int stream_clock_sync;
+  void updateClockMapping();
+
+  // Heap allocation checks for the message building in each stream. Only
+  // active in ROSARNL_ALLOC_CHECK builds.
+  AllocationCheck pose_alloc_check{"amcl_pose"};
+  AllocationCheck tf_alloc_check{"tf"};
+  AllocationCheck odom_alloc_check{"odom"};
+  AllocationCheck extrapolated_pose_alloc_check{"extrapolated_pose"};
+  AllocationCheck feedback_alloc_check{"move_base/feedback"};
+  AllocationCheck state_alloc_check{"state topics"};
 
   /**
    * @breif Convert ROS pose message to Aria ArPose type
@@ -179,28 +327,30 @@ protected:
   ros::Publisher motors_state_pub;
   ros::Publisher dock_state_pub;
   std_msgs::Bool motors_state;
-  std_msgs::String dock_state;
-  bool published_motors_state;
-  bool published_dock_state;
+  std::vector<std_msgs::String> dock_state_msgs;
 
   geometry_msgs::PoseWithCovarianceStamped pose_msg;
   ros::Publisher pose_pub;
 
+  geometry_msgs::PoseStamped extrapolated_pose_msg;
+  ros::Publisher extrapolated_pose_pub;
+
   // Battery publishing
   ros::Publisher battery_pub;
-  ros::Time last_battery_pub_time;
-  ros::Duration battery_pub_period;
+  rosarnl::BatteryStatus battery_msg;
 
-  geometry_msgs::TransformStamped map_trans;
-  tf::TransformBroadcaster map_broadcaster;
+  move_base_msgs::MoveBaseFeedback feedback_msg;
 
-  std::string tf_prefix;
-  std::string frame_id_map;
-  std::string frame_id_base_link;
-  std::string frame_id_bumper;
-  std::string frame_id_sonar;
+  ros::Publisher tf_pub;
+  tf2_msgs::TFMessage tf_msg;
 
-  tf::TransformListener listener;
+  ros::Publisher odom_pub;
+  nav_msgs::Odometry odom_msg;
+  tf2_msgs::TFMessage odom_tf_msg;
+
+  tf2_ros::Buffer tf_buffer;
+  tf2_ros::TransformListener tf_listener{tf_buffer};
+  tf2_ros::StaticTransformBroadcaster static_tf;
 
   ros::Subscriber initialpose_sub;
   void initialpose_sub_cb(const geometry_msgs::PoseStampedConstPtr &msg);
@@ -212,12 +362,20 @@ protected:
   ros::Publisher arnl_path_state_pub;
   void arnl_path_state_change_cb();
 
-  std::string lastServerStatus;
-  std::string lastServerMode;
+  std_msgs::String server_status_msg;
+  std_msgs::String server_mode_msg;
 
-  // aria call back for cmdvel
+  // cmd_vel. The subscriber callback only writes the command into
+  // cmd_vel_mailbox; cmdVelTask() applies it as an ArRobot user task on the
+  // next robot cycle, and stops the robot if commands stop arriving for
+  // cmd_vel_timeout.
   ros::Subscriber cmd_drive_sub;
   void cmdvel_cb( const geometry_msgs::TwistConstPtr &msg);
+  CmdVelMailbox cmd_vel_mailbox;
+  void cmdVelTask();
+  ArFunctorC<RosArnlNode> myCmdVelCB;
+  unsigned long cmd_vel_applied_seq;  // only used by cmdVelTask()
+  bool cmd_vel_driving;               // only used by cmdVelTask()
 
   // just request a goal, no actionlib interface:
   ros::Subscriber simple_goal_sub;
@@ -241,9 +399,31 @@ protected:
   typedef actionlib::SimpleActionServer<move_base_msgs::MoveBaseAction> ArnlActionServer;
   ArnlActionServer actionServer;
   void execute_action_cb(const move_base_msgs::MoveBaseGoalConstPtr& goal);
-  bool arnl_goal_done;
-  bool action_executing;
+  std::atomic<bool> action_executing;
+
+  // What ARNL reported about the action's goal, set by the arnl_goal_*_cb
+  // callbacks (path planning thread) and consumed by execute_action_cb().
+  // Guarded by action_mutex; changes are signalled on action_cond.
+  enum {
+    ActionOutcomeNone,
+    ActionOutcomeSucceeded,
+    ActionOutcomeFailed,
+    ActionOutcomeInterrupted
+  };
+  std::mutex action_mutex;
+  std::condition_variable action_cond;
+  int action_outcome;
+  bool action_preempt_signalled;
+  double action_goal_x, action_goal_y;  // goal requested from ARNL (mm)
+
+  /// Transform @a target to the map frame and send ARNL there.
+  bool start_action_goal(const geometry_msgs::PoseStamped& target);
+  /// actionlib preempt callback, wakes execute_action_cb().
+  void action_preempt_cb();
+  void signal_action_outcome(int outcome, const ArPose& p);
   bool shutdown_requested;
+  std::mutex shutdown_mutex;
+  std::condition_variable shutdown_cond;
   void arnl_goal_reached_cb(ArPose p);
   void arnl_goal_failed_cb(ArPose p);
   void arnl_goal_interrupted_cb(ArPose p);
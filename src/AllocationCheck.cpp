@@ -0,0 +1,71 @@
+#include "rosarnl/AllocationCheck.h"
+
+#ifdef ROSARNL_ALLOC_CHECK
+
+#include <ros/ros.h>
+
+#include <cstdlib>
+#include <new>
+
+// Number of calls to operator new made by each thread. Plain thread_local
+// integer so that counting itself never allocates.
+static thread_local unsigned long thread_allocations = 0;
+
+void* operator new(std::size_t size)
+{
+  ++thread_allocations;
+  void *p = std::malloc(size ? size : 1);
+  if(!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  ++thread_allocations;
+  return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+  return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void *p, const std::nothrow_t&) noexcept { std::free(p); }
+
+unsigned long AllocationCheck::threadAllocations()
+{
+  return thread_allocations;
+}
+
+void AllocationCheck::begin()
+{
+  start_count = thread_allocations;
+}
+
+void AllocationCheck::end()
+{
+  const unsigned long n = thread_allocations - start_count;
+  if(cycles < warmup)
+  {
+    ++cycles;
+    return;
+  }
+  if(n != 0)
+  {
+    ROS_FATAL_NAMED("rosarnl_node", "rosarnl_node: allocation check failed: %s made %lu heap allocation(s) after %lu warm-up cycles.", name, n, warmup);
+    std::abort();
+  }
+}
+
+#endif
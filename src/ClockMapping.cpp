@@ -0,0 +1,132 @@
+#include "rosarnl/ClockMapping.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Steady state filter gains. beta ~= alpha^2 / (2 - alpha) keeps the filter
+// critically damped; with ArTime's 1 ms resolution and 1 Hz updates this
+// gives well under 1 ppm of drift noise.
+static const double min_alpha = 0.05;
+static const double min_beta = 0.0013;
+
+// Number of back-to-back clock reads per update; the one with the shortest
+// ROS clock bracket is kept.
+static const int pairs_per_update = 5;
+
+// Clock rate error (sec/sec) allowed on top of step_threshold before a
+// residual counts as a step. Until the second sample after a (re)start the
+// drift is unknown, and a simulated clock can run well off ARIA's (real
+// time factor 0.5 to 1.5 is learned rather than reset on); after that the
+// prediction includes the drift and only changes in rate are left.
+static const double learning_rate_tolerance = 0.5;
+static const double rate_tolerance = 0.01;
+
+constexpr double ClockMapping::step_threshold;
+
+ClockMapping& ClockMapping::instance()
+{
+  static ClockMapping m;
+  return m;
+}
+
+ClockMapping::ClockMapping() :
+  seq(0),
+  offset_pub(0), drift_pub(0), ref_pub(0),
+  offset(0), drift(0), last_aria(0),
+  samples(0), resets(0),
+  residual_ms(0), jitter_sq(0), read_gap_ms(0), last_update_ros(0),
+  samples_pub(0), resets_pub(0)
+{
+  // Conversions may be requested before the first scheduled update.
+  update();
+}
+
+void ClockMapping::update()
+{
+  double best_aria = 0, best_ros = 0, best_gap = -1;
+  for(int i = 0; i < pairs_per_update; ++i)
+  {
+    const ros::Time r1 = ros::Time::now();
+    const ArTime a;
+    const ros::Time r2 = ros::Time::now();
+    const double gap = (r2 - r1).toSec();
+    if(best_gap < 0 || gap < best_gap)
+    {
+      best_gap = gap;
+      best_aria = ariaSec(a);
+      best_ros = r1.toSec() + gap / 2.0;
+    }
+  }
+  addSample(best_aria, best_ros, best_gap);
+}
+
+void ClockMapping::addSample(double aria, double ros_sec, double read_gap)
+{
+  const double measured = ros_sec - aria;
+  const double dt = aria - last_aria;
+  const double predicted = offset + drift * dt;
+  const double residual = measured - predicted;
+
+  ++samples;
+  const double tolerance = step_threshold + (samples == 2 ? learning_rate_tolerance : rate_tolerance) * dt;
+  if(samples == 1 || dt <= 0 || std::fabs(residual) > tolerance)
+  {
+    if(samples > 1)
+    {
+      ++resets;
+      ROS_WARN_NAMED("rosarnl_node", "rosarnl_node: ROS clock stepped by %.3f sec relative to ARIA clock, restarting clock mapping.", residual);
+    }
+    // A step leaves the clock rates alone, so the drift learned so far is
+    // kept; the next sample re-estimates it anyway.
+    samples = 1;
+    offset = measured;
+    jitter_sq.store(0, std::memory_order_relaxed);
+  }
+  else
+  {
+    // Gains start as a growing-memory least squares fit of offset and drift
+    // and settle to fixed values.
+    const double n = samples;
+    const double alpha = std::max(min_alpha, 2.0 * (2.0 * n - 1.0) / (n * (n + 1.0)));
+    const double beta = std::max(min_beta, 6.0 / (n * (n + 1.0)));
+    offset = predicted + alpha * residual;
+    drift += beta * residual / dt;
+    const double r_ms = residual * 1000.0;
+    const double j = jitter_sq.load(std::memory_order_relaxed);
+    jitter_sq.store(samples == 2 ? r_ms * r_ms : 0.9 * j + 0.1 * r_ms * r_ms, std::memory_order_relaxed);
+  }
+  last_aria = aria;
+  writeParams(offset, drift, last_aria);
+
+  residual_ms.store(samples == 1 ? 0.0 : residual * 1000.0, std::memory_order_relaxed);
+  read_gap_ms.store(read_gap * 1000.0, std::memory_order_relaxed);
+  last_update_ros.store(ros_sec, std::memory_order_relaxed);
+  samples_pub.fetch_add(1, std::memory_order_relaxed);
+  resets_pub.store(resets, std::memory_order_relaxed);
+}
+
+void ClockMapping::writeParams(double off, double d, double ref)
+{
+  const unsigned long s = seq.load(std::memory_order_relaxed);
+  seq.store(s + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  offset_pub.store(off, std::memory_order_relaxed);
+  drift_pub.store(d, std::memory_order_relaxed);
+  ref_pub.store(ref, std::memory_order_relaxed);
+  seq.store(s + 2, std::memory_order_release);
+}
+
+ClockMapping::Quality ClockMapping::getQuality() const
+{
+  Quality q;
+  double off, d, ref;
+  readParams(off, d, ref);
+  q.residual_ms = residual_ms.load(std::memory_order_relaxed);
+  q.jitter_ms = std::sqrt(jitter_sq.load(std::memory_order_relaxed));
+  q.drift_ppm = d * 1e6;
+  q.read_gap_ms = read_gap_ms.load(std::memory_order_relaxed);
+  q.age = ros::Time::now().toSec() - last_update_ros.load(std::memory_order_relaxed);
+  q.samples = samples_pub.load(std::memory_order_relaxed);
+  q.resets = resets_pub.load(std::memory_order_relaxed);
+  return q;
+}
@@ -0,0 +1,96 @@
+#include <assert.h>
+
+#include "rosarnl/CovarianceWorker.h"
+
+#include "Aria/Aria.h"
+#include "Arnl.h"
+#include "ArLocalizationTask.h"
+
+CovarianceWorker::CovarianceWorker(ArLocalizationTask *_locTask, const RosArnlConfigStore& _config, const boost::function<bool()>& _wanted) :
+  locTask(_locTask),
+  config(_config),
+  wanted(_wanted),
+  have_result(false),
+  running(false)
+{
+  assert(locTask);
+  for(int i = 0; i < 9; ++i)
+    latest_var[i] = 0;
+}
+
+CovarianceWorker::~CovarianceWorker()
+{
+  stop();
+}
+
+void CovarianceWorker::start()
+{
+  if(running)
+    return;
+  running = true;
+  thread = std::thread(&CovarianceWorker::threadMain, this);
+}
+
+void CovarianceWorker::stop()
+{
+  running = false;
+  wait_cond.notify_all();
+  if(thread.joinable())
+    thread.join();
+}
+
+bool CovarianceWorker::getLatest(double var[9], ArTime& locTime) const
+{
+  std::lock_guard<std::mutex> lock(result_mutex);
+  if(!have_result)
+    return false;
+  for(int i = 0; i < 9; ++i)
+    var[i] = latest_var[i];
+  locTime = latest_loc_time;
+  return true;
+}
+
+void CovarianceWorker::threadMain()
+{
+  ArTime lastLocTime;
+  bool computed = false;
+  while(running)
+  {
+    const RosArnlConfig& cfg = config.get();
+    const double rate = (cfg.covariance_rate > 0) ? cfg.covariance_rate : 1.0;
+
+    if(cfg.use_covariance && wanted())
+    {
+      // No need to walk the sample set again if ARNL has not localized since
+      // the last result.
+      const ArTime locTime = locTask->getLastLocaTime();
+      if(!computed || !locTime.isAt(lastLocTime))
+      {
+        ArMatrix var;
+        ArPose meanp;
+        if(locTask->findLocalizationMeanVar(meanp, var))
+        {
+          std::lock_guard<std::mutex> lock(result_mutex);
+          for(int r = 0; r < 3; ++r)
+            for(int c = 0; c < 3; ++c)
+              latest_var[r*3 + c] = var(r, c);
+          latest_loc_time = locTime;
+          have_result = true;
+          lastLocTime = locTime;
+          computed = true;
+        }
+      }
+    }
+    else if(!cfg.use_covariance && computed)
+    {
+      // Don't hand out a result from before it was turned off once it is
+      // turned on again.
+      std::lock_guard<std::mutex> lock(result_mutex);
+      have_result = false;
+      computed = false;
+    }
+
+    std::unique_lock<std::mutex> lock(wait_mutex);
+    wait_cond.wait_for(lock, std::chrono::duration<double>(1.0 / rate), [this] { return !running; });
+  }
+}
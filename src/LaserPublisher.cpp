@@ -4,56 +4,132 @@
 
 #include "rosarnl/ArTimeToROSTime.h"
 
+#include <tf/tf.h>
+
+#include "Aria/ArSystemStatus.h"
+
+#include <algorithm>
 #include <math.h>
+#include <string.h>
 
 
-// TODO publish transform for sensor position?
-// TODO publish pointcloud of cumulative readings in separate topic?
 // TODO generic pointcloud sensor publisher (seprate point cloud stuff there)
-// TODO sonar publisher? (take from rosaria)
 
-LaserPublisher::LaserPublisher(ArLaser *_l, ros::NodeHandle& _n, bool _broadcast_tf, const std::string& _tf_frame, const std::string& _parent_tf_frame, const std::string& _global_tf_frame) :
+LaserPublisher::LaserPublisher(ArLaser *_l, ros::NodeHandle& _n, tf2_ros::StaticTransformBroadcaster& _static_tf, const std::string& _tf_frame, const std::string& _parent_tf_frame, const std::string& _cloud_frame) :
   laserReadingsCB(this, &LaserPublisher::readingsCB),
+  reading_cb_active(false),
   node(_n),
   laser(_l),
   tfname(_tf_frame),
   parenttfname(_parent_tf_frame),
-  globaltfname(_global_tf_frame),
-  broadcast_tf(_broadcast_tf)
+  capture_fresh(false),
+  publish_thread_running(false),
+  merged_scan(NULL),
+  merged_index(0),
+  beam_table_increment(0),
+  link_quality_full_rate(0),
+  max_scan_skip(0),
+  scan_skip(0),
+  scans_skipped(0),
+  cumulative_keyframe_interval(20),
+  cumulative_since_keyframe(0),
+  cumulative_subscribers(0),
+  capture_alloc_check("laser capture"),
+  scan_alloc_check("laser scan"),
+  compact_alloc_check("compact laser scan"),
+  cloud_alloc_check("laser point cloud"),
+  cumulative_alloc_check("laser cumulative delta"),
+  readings_latency(std::string(_l->getName()) + " readingsCB"),
+  lock_hold_latency(std::string(_l->getName()) + " lockDevice hold"),
+  scan_latency(std::string(_l->getName()) + " buildLaserScan"),
+  compact_latency(std::string(_l->getName()) + " publishCompactScan"),
+  cloud_latency(std::string(_l->getName()) + " publishPointCloud"),
+  cloud2_latency(std::string(_l->getName()) + " publishPointCloud2"),
+  cumulative_latency(std::string(_l->getName()) + " publishCumulativeDelta")
 {
   assert(_l);
-  laser->lockDevice();
-  laser->addReadingCB(&laserReadingsCB);
-  laser->unlockDevice();
   std::string laserscan_name(laser->getName());
   laserscan_name += "_laserscan";
   std::string pointcloud_name(laser->getName());
   pointcloud_name += "_pointcloud";
-  laserscan_pub = node.advertise<sensor_msgs::LaserScan>(laserscan_name, 20);
-  pointcloud_pub = node.advertise<sensor_msgs::PointCloud>(pointcloud_name, 50);
+  std::string pointcloud2_name(laser->getName());
+  pointcloud2_name += "_pointcloud2";
+  std::string compact_name(laser->getName());
+  compact_name += "_compact_scan";
+  std::string cumulative_name(laser->getName());
+  cumulative_name += "_cumulative_delta";
+  // The laser's reading callback is only registered while any of these has a
+  // subscriber, see updateActivation().
+  ros::SubscriberStatusCallback subscribers_cb = boost::bind(&LaserPublisher::subscribersChanged, this, _1);
+  laserscan_pub = node.advertise<sensor_msgs::LaserScan>(laserscan_name, 20, subscribers_cb, subscribers_cb);
+  pointcloud_pub = node.advertise<sensor_msgs::PointCloud>(pointcloud_name, 50, subscribers_cb, subscribers_cb);
+  pointcloud2_pub = node.advertise<sensor_msgs::PointCloud2>(pointcloud2_name, 50, subscribers_cb, subscribers_cb);
+  compact_pub = node.advertise<rosarnl::CompactScan>(compact_name, 20, subscribers_cb, subscribers_cb);
+  cumulative_pub = node.advertise<rosarnl::CumulativeCloudDelta>(cumulative_name, 20, subscribers_cb, subscribers_cb);
 
-  tf::Quaternion q;
-  if(laser->hasSensorPosition())
-  {
-    lasertf.setOrigin(tf::Vector3(laser->getSensorPositionX()/1000.0, laser->getSensorPositionY()/1000.0, laser->getSensorPositionZ()/1000.0));
-    q.setRPY(0, 0, ArMath::degToRad(laser->getSensorPositionTh()));
-  }
-  else
+  // Mount position on the robot
+  mount_x = laser->hasSensorPosition() ? laser->getSensorPositionX() / 1000.0 : 0.0;
+  mount_y = laser->hasSensorPosition() ? laser->getSensorPositionY() / 1000.0 : 0.0;
+  mount_th = laser->hasSensorPosition() ? ArMath::degToRad(laser->getSensorPositionTh()) : 0.0;
+
+  laserscan.header.frame_id = tfname;
+  scan_builder.angle_min = ArMath::degToRad(laser->getStartDegrees());
+  scan_builder.angle_max = ArMath::degToRad(laser->getEndDegrees());
+  scan_builder.range_max = laser->getMaxRange() / 1000.0;
+  laserscan.angle_min = scan_builder.angle_min;
+  laserscan.angle_max = scan_builder.angle_max;
+
+  // Output modes to save bandwidth: keep only every decimation'th reading,
+  // and drop readings outside crop_min..crop_max.
+  const std::string param_prefix(laser->getName());
+  node.param(param_prefix + "_decimation", scan_builder.decimation, 1);
+  node.param(param_prefix + "_crop_min", scan_builder.crop_min, 0.0);
+  node.param(param_prefix + "_crop_max", scan_builder.crop_max, 0.0);
+  if(scan_builder.decimation < 1)
+    scan_builder.decimation = 1;
+  laserscan.range_min = scan_builder.crop_min;
+  laserscan.range_max = (scan_builder.crop_max > 0 && scan_builder.crop_max < scan_builder.range_max) ? scan_builder.crop_max : scan_builder.range_max;
+  pointcloud.header.frame_id = _cloud_frame;
+
+  // Unorganized cloud of packed little endian float32 x, y, z points.
+  pointcloud2.header.frame_id = _cloud_frame;
+  pointcloud2.height = 1;
+  pointcloud2.is_bigendian = false;
+  pointcloud2.is_dense = true;
+  pointcloud2.point_step = 3 * sizeof(float);
+  pointcloud2.fields.resize(3);
+  const char *field_names[3] = { "x", "y", "z" };
+  for(size_t i = 0; i < 3; ++i)
   {
-    lasertf.setOrigin(tf::Vector3(0, 0, 0));
-    q.setRPY(0, 0, 0);
+    pointcloud2.fields[i].name = field_names[i];
+    pointcloud2.fields[i].offset = i * sizeof(float);
+    pointcloud2.fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+    pointcloud2.fields[i].count = 1;
   }
-  lasertf.setRotation(q);
-  
 
-  laserscan.header.frame_id = "laser_frame";
-  laserscan.angle_min = ArMath::degToRad(laser->getStartDegrees());
-  laserscan.angle_max = ArMath::degToRad(laser->getEndDegrees());
-  laserscan.range_min = 0;
-  laserscan.range_max = laser->getMaxRange() / 1000.0;
-  pointcloud.header.frame_id = "odom";
+  // Sensors that can report reflector bits put them in each reading's extra
+  // int, published as intensities.
+  have_intensities = laser->canChooseReflectorBits();
+
+  // Time between scans, used for scan_time and time_increment. Unless set
+  // with the <laser>_scan_time parameter, it is measured from the reading
+  // times (see ScanTimeEstimator).
+  node.param(param_prefix + "_scan_time", fixed_scan_time, 0.0);
 
-  ROS_INFO("Global: %s Parent: %s", globaltfname.c_str(), parenttfname.c_str());
+  // All points lie in the plane of the laser.
+  sensor_z = laser->hasSensorPosition() ? laser->getSensorPositionZ() / 1000.0 : 0.0;
+
+  // The mount never moves, so its transform is only sent once.
+  geometry_msgs::TransformStamped mount;
+  mount.header.stamp = ros::Time::now();
+  mount.header.frame_id = parenttfname;
+  mount.child_frame_id = tfname;
+  mount.transform.translation.x = mount_x;
+  mount.transform.translation.y = mount_y;
+  mount.transform.translation.z = sensor_z;
+  mount.transform.rotation = tf::createQuaternionMsgFromYaw(mount_th);
+  _static_tf.sendTransform(mount);
+  ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: Laser %s: frame %s, mounted on %s", laser->getName(), tfname.c_str(), parenttfname.c_str());
   
   // Get angle_increment of the laser
   laserscan.angle_increment = 0;
@@ -65,6 +141,46 @@ LaserPublisher::LaserPublisher(ArLaser *_l, ros::NodeHandle& _n, bool _broadcast
   }
   assert(laserscan.angle_increment > 0);
   laserscan.angle_increment *= M_PI/180.0;  
+  scan_builder.angle_increment = laserscan.angle_increment;
+
+  // Reserve room for a full scan up front so that resizing the messages for
+  // each scan reuses the same storage. The current buffer can hold one point
+  // per reading. (If a laser ever returns more, the vectors grow once and
+  // keep the larger capacity.)
+  max_readings = (size_t) ceil((laser->getEndDegrees() - laser->getStartDegrees()) / (laserscan.angle_increment * 180.0/M_PI)) + 1;
+  laserscan.ranges.reserve(max_readings);
+  if(have_intensities)
+    laserscan.intensities.reserve(max_readings);
+  pointcloud.points.reserve(max_readings);
+  pointcloud2.data.reserve(max_readings * pointcloud2.point_step);
+  compact_scan.header.frame_id = laserscan.header.frame_id;
+  compact_scan.ranges.reserve(compactRangesMaxBytes(max_readings));
+
+  // The cumulative buffer is the same points as pointcloud, so it's in the
+  // same frame.
+  const size_t max_cumulative = laser->getCumulativeBufferSize();
+  cumulative_delta.header.frame_id = pointcloud.header.frame_id;
+  cumulative_delta.sequence = 0;
+  cumulative_delta.z = sensor_z;
+  cumulative_delta.added.reserve(2 * max_cumulative);
+  cumulative_delta.removed.reserve(2 * max_cumulative);
+  cumulative_sent.reserve(max_cumulative);
+  cumulative_diff.reserve(max_cumulative);
+  LaserCapture *captures[3] = { &capture_back, &capture_ready, &capture_front };
+  for(size_t i = 0; i < 3; ++i)
+  {
+    captures[i]->ranges.reserve(max_readings);
+    captures[i]->ignore_mask.reserve(rangeIgnoreMaskWords(max_readings));
+    if(have_intensities)
+      captures[i]->intensities.reserve(max_readings);
+    captures[i]->cloud_xy.reserve(2 * max_readings);
+    captures[i]->cumulative.reserve(max_cumulative);
+  }
+
+  publish_thread_running = true;
+  publish_thread = std::thread(&LaserPublisher::publishThreadMain, this);
+
+  updateActivation();
 }
 
 LaserPublisher::~LaserPublisher()
@@ -72,81 +188,371 @@ LaserPublisher::~LaserPublisher()
   laser->lockDevice();
   laser->remReadingCB(&laserReadingsCB);
   laser->unlockDevice();
+
+  {
+    std::lock_guard<std::mutex> lock(capture_mutex);
+    publish_thread_running = false;
+  }
+  capture_cond.notify_all();
+  if(publish_thread.joinable())
+    publish_thread.join();
 }
 
-void LaserPublisher::readingsCB()
+void LaserPublisher::setMergedScanPublisher(MergedScanPublisher *m)
 {
-  assert(laser);
-  laser->lockDevice();
-  publishLaserScan();
-  publishPointCloud();
-  laser->unlockDevice();
-  if(broadcast_tf)
-    transform_broadcaster.sendTransform(tf::StampedTransform(lasertf, convertArTimeToROS(laser->getLastReadingTime()), parenttfname, tfname));
+  assert(m);
+  beam_cos.reserve(max_readings);
+  beam_sin.reserve(max_readings);
+  merged_xy.reserve(2 * max_readings);
+  const double reach = laserscan.range_max + hypot(mount_x, mount_y);
+  merged_index = m->addLaser(laser->getName(), reach, max_readings);
+  merged_scan.store(m, std::memory_order_release);
+  m->addSubscriberChangeCB(boost::bind(&LaserPublisher::updateActivation, this));
+  updateActivation();
 }
 
-void LaserPublisher::publishLaserScan()
+void LaserPublisher::setAdaptiveRate(int full_rate_quality, int max_skip)
 {
-  laserscan.header.stamp = convertArTimeToROS(laser->getLastReadingTime());
-  const std::list<ArSensorReading*> *readings = laser->getRawReadings(); 
-  assert(readings);
+  max_scan_skip.store(std::max(max_skip, 0), std::memory_order_relaxed);
+  link_quality_full_rate.store(full_rate_quality, std::memory_order_relaxed);
+}
 
-  laserscan.ranges.resize(readings->size());
+void LaserPublisher::setCumulativeKeyframeInterval(int interval)
+{
+  cumulative_keyframe_interval.store(std::max(interval, 1), std::memory_order_relaxed);
+}
 
-  size_t n = 0;
-  if (laser->getFlipped()) {
-    // Reverse the data
-    for(std::list<ArSensorReading*>::const_reverse_iterator r = readings->rbegin(); r != readings->rend(); ++r)
+void LaserPublisher::readingsCB()
+{
+  LatencyScope timer(readings_latency);
+  assert(laser);
+  LaserCapture& c = capture_back;
+  const bool want_cloud = pointcloud_pub.getNumSubscribers() > 0 || pointcloud2_pub.getNumSubscribers() > 0;
+  const bool want_cumulative = cumulative_pub.getNumSubscribers() > 0;
+
+  capture_alloc_check.begin();
+  laser->lockDevice();
+  {
+    LatencyScope lock_timer(lock_hold_latency);
+    c.time = laser->getLastReadingTime();
+    c.flipped = laser->getFlipped();
+
+    const std::list<ArSensorReading*> *readings = laser->getRawReadings();
+    assert(readings);
+    c.ranges.resize(readings->size());
+    c.ignore_mask.assign(rangeIgnoreMaskWords(readings->size()), 0);
+    c.intensities.resize(have_intensities ? readings->size() : 0);
+    size_t n = 0;
+    for(std::list<ArSensorReading*>::const_iterator r = readings->begin(); r != readings->end(); ++r)
     {
       assert(*r);
-      
-      if ((*r)->getIgnoreThisReading()) {
-	laserscan.ranges[n] = -1;
-      }
-      else {
-	laserscan.ranges[n] = (*r)->getRange() / 1000.0;
-      }
-      
+      c.ranges[n] = (*r)->getRange();
+      setRangeIgnored(c.ignore_mask.data(), n, (*r)->getIgnoreThisReading());
+      if(have_intensities)
+        c.intensities[n] = (*r)->getExtraInt();
       ++n;
     }
-  }
-  else {
-    for(std::list<ArSensorReading*>::const_iterator r = readings->begin(); r != readings->end(); ++r)
+
+    c.have_cloud = want_cloud;
+    c.cloud_xy.clear();
+    if(want_cloud)
     {
-      assert(*r);
-      
-      if ((*r)->getIgnoreThisReading()) {
-	laserscan.ranges[n] = -1;
+      assert(laser->getCurrentBuffer());
+      const std::list<ArPoseWithTime*> *p = laser->getCurrentRangeBuffer()->getBuffer();
+      assert(p);
+      c.cloud_xy.resize(2 * p->size());
+      n = 0;
+      for(std::list<ArPoseWithTime*>::const_iterator i = p->begin(); i != p->end(); ++i)
+      {
+        assert(*i);
+        c.cloud_xy[n++] = (*i)->getX() / 1000.0;
+        c.cloud_xy[n++] = (*i)->getY() / 1000.0;
       }
-      else {
-	laserscan.ranges[n] = (*r)->getRange() / 1000.0;
-      }
-      
-      ++n;
+    }
+
+    c.have_cumulative = want_cumulative;
+    c.cumulative.clear();
+    if(want_cumulative)
+    {
+      const std::list<ArPoseWithTime*> *p = laser->getCumulativeBuffer();
+      assert(p);
+      for(std::list<ArPoseWithTime*>::const_iterator i = p->begin(); i != p->end(); ++i)
+        c.cumulative.push_back(cumulativeKey(ArMath::roundInt((*i)->getX()), ArMath::roundInt((*i)->getY())));
     }
   }
+  laser->unlockDevice();
+  capture_alloc_check.end();
 
-  laserscan_pub.publish(laserscan);
+  // Hand the capture to publishThreadMain(). If it hasn't taken the previous
+  // one yet, that one is replaced (and its storage reused for the next
+  // capture).
+  {
+    std::lock_guard<std::mutex> lock(capture_mutex);
+    std::swap(capture_back, capture_ready);
+    capture_fresh = true;
+  }
+  capture_cond.notify_one();
 }
 
-void LaserPublisher::publishPointCloud()
+void LaserPublisher::publishThreadMain()
 {
-  assert(laser);
-  pointcloud.header.stamp = convertArTimeToROS(laser->getLastReadingTime());
-  assert(laser->getCurrentBuffer());
-  const std::list<ArPoseWithTime*> *p = laser->getCurrentRangeBuffer()->getBuffer();
-  assert(p);
-  pointcloud.points.resize(p->size());
-  size_t n = 0;
-  for(std::list<ArPoseWithTime*>::const_iterator i = p->begin(); i != p->end(); ++i)
+  while(publish_thread_running)
   {
-    assert(*i);
-    pointcloud.points[n].x = (*i)->getX() / 1000.0;
-    pointcloud.points[n].y = (*i)->getY() / 1000.0;
-    pointcloud.points[n].z = (laser->hasSensorPosition() ?  laser->getSensorPositionZ() / 1000.0 : 0.0);
-    ++n;
+    {
+      std::unique_lock<std::mutex> lock(capture_mutex);
+      capture_cond.wait(lock, [this] { return capture_fresh || !publish_thread_running; });
+      if(!publish_thread_running)
+        return;
+      std::swap(capture_ready, capture_front);
+      capture_fresh = false;
+    }
+
+    // laserscan is also the source of the compact and merged scans
+    const bool want_scan = laserscan_pub.getNumSubscribers() > 0;
+    const bool want_compact = compact_pub.getNumSubscribers() > 0;
+    MergedScanPublisher *merged = merged_scan.load(std::memory_order_acquire);
+    const bool want_merged = merged && merged->wanted();
+    scan_time_est.addStamp(ClockMapping::instance().ariaSec(capture_front.time));
+    if(want_scan || want_compact || want_merged)
+      buildLaserScan(capture_front);
+    if(throttleScan())
+    {
+      if(want_scan)
+        laserscan_pub.publish(laserscan);
+      if(want_compact)
+        publishCompactScan();
+      // sensor_msgs/PointCloud is deprecated, only build it if someone still
+      // uses it.
+      if(capture_front.have_cloud && pointcloud_pub.getNumSubscribers() > 0)
+        publishPointCloud(capture_front);
+      if(capture_front.have_cloud && pointcloud2_pub.getNumSubscribers() > 0)
+        publishPointCloud2(capture_front);
+      if(capture_front.have_cumulative)
+        publishCumulativeDelta(capture_front);
+    }
+    if(want_merged)
+      addMergedScan(capture_front);
+
+    // Catch a last subscriber disconnecting before the status callback could
+    // see it gone.
+    if(!wanted())
+      updateActivation();
   }
+}
+
+bool LaserPublisher::wanted() const
+{
+  if(laserscan_pub.getNumSubscribers() > 0 || pointcloud_pub.getNumSubscribers() > 0 ||
+     pointcloud2_pub.getNumSubscribers() > 0 || compact_pub.getNumSubscribers() > 0 ||
+     cumulative_pub.getNumSubscribers() > 0)
+    return true;
+  MergedScanPublisher *merged = merged_scan.load(std::memory_order_acquire);
+  return merged && merged->wanted();
+}
+
+void LaserPublisher::subscribersChanged(const ros::SingleSubscriberPublisher&)
+{
+  updateActivation();
+}
+
+void LaserPublisher::updateActivation()
+{
+  std::lock_guard<std::mutex> lock(activation_mutex);
+  const bool want = wanted();
+  if(want == reading_cb_active)
+    return;
+  laser->lockDevice();
+  if(want)
+    laser->addReadingCB(&laserReadingsCB);
+  else
+    laser->remReadingCB(&laserReadingsCB);
+  laser->unlockDevice();
+  reading_cb_active = want;
+  ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: Laser %s: %s", laser->getName(), want ? "subscribed, processing readings" : "no subscribers, stopped processing readings");
+}
+
+void LaserPublisher::buildLaserScan(const LaserCapture& c)
+{
+  LatencyScope timer(scan_latency);
+  scan_alloc_check.begin();
+  laserscan.header.stamp = convertArTimeToROS(c.time);
+  scan_builder.build(c.ranges.data(), c.ignore_mask.data(), c.ranges.size(), c.flipped,
+                     c.intensities.data(), c.intensities.size(),
+                     fixed_scan_time > 0 ? fixed_scan_time : scan_time_est.get(), laserscan);
+  scan_alloc_check.end();
+}
+
+void LaserPublisher::publishCompactScan()
+{
+  LatencyScope timer(compact_latency);
+  compact_alloc_check.begin();
+  compact_scan.header.stamp = laserscan.header.stamp;
+  compact_scan.angle_min = laserscan.angle_min;
+  compact_scan.angle_increment = laserscan.angle_increment;
+  compact_scan.time_increment = laserscan.time_increment;
+  compact_scan.scan_time = laserscan.scan_time;
+  compact_scan.range_min = laserscan.range_min;
+  compact_scan.range_max = laserscan.range_max;
+  compact_scan.count = laserscan.ranges.size();
+  compact_scan.ranges.resize(compactRangesMaxBytes(laserscan.ranges.size()));
+  compact_scan.ranges.resize(encodeCompactRanges(laserscan.ranges.data(), laserscan.ranges.size(), compact_scan.ranges.data()));
+  compact_alloc_check.end();
+  compact_pub.publish(compact_scan);
+}
+
+bool LaserPublisher::throttleScan()
+{
+  // Skip more scans the further the link quality is below
+  // link_quality_full_rate: at half of it every other scan is published, at
+  // a third every third, and so on. A quality of 0 or less means there is no
+  // wireless information (e.g. a wired link), so nothing is skipped.
+  const int full_rate = link_quality_full_rate.load(std::memory_order_relaxed);
+  int skip = 0;
+  if(full_rate > 0)
+  {
+    const int quality = ArSystemStatus::getWirelessLinkQuality();
+    if(quality > 0 && quality < full_rate)
+      skip = std::min((full_rate + quality - 1) / quality - 1, max_scan_skip.load(std::memory_order_relaxed));
+  }
+  if(skip != scan_skip)
+  {
+    ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: Laser %s: publishing 1 in %d scans for wireless link quality", laser->getName(), skip + 1);
+    scan_skip = skip;
+  }
+  if(scans_skipped < scan_skip)
+  {
+    ++scans_skipped;
+    return false;
+  }
+  scans_skipped = 0;
+  return true;
+}
+
+void LaserPublisher::publishPointCloud(const LaserCapture& c)
+{
+  LatencyScope timer(cloud_latency);
+  cloud_alloc_check.begin();
+  pointcloud.header.stamp = convertArTimeToROS(c.time);
+  const size_t size = c.cloud_xy.size() / 2;
+  pointcloud.points.resize(size);
+  for(size_t n = 0; n < size; ++n)
+  {
+    pointcloud.points[n].x = c.cloud_xy[2*n];
+    pointcloud.points[n].y = c.cloud_xy[2*n+1];
+    pointcloud.points[n].z = sensor_z;
+  }
+  cloud_alloc_check.end();
   pointcloud_pub.publish(pointcloud);
 }
-  
-  
+
+void LaserPublisher::publishPointCloud2(const LaserCapture& c)
+{
+  LatencyScope timer(cloud2_latency);
+  cloud_alloc_check.begin();
+  pointcloud2.header.stamp = convertArTimeToROS(c.time);
+  pointcloud2.width = c.cloud_xy.size() / 2;
+  pointcloud2.row_step = pointcloud2.width * pointcloud2.point_step;
+  pointcloud2.data.resize(pointcloud2.row_step);
+  unsigned char *out = pointcloud2.data.data();
+  for(size_t n = 0; n < pointcloud2.width; ++n)
+  {
+    const float xyz[3] = { c.cloud_xy[2*n], c.cloud_xy[2*n+1], sensor_z };
+    memcpy(out, xyz, sizeof(xyz));
+    out += sizeof(xyz);
+  }
+  cloud_alloc_check.end();
+  pointcloud2_pub.publish(pointcloud2);
+}
+
+void LaserPublisher::addMergedScan(const LaserCapture& c)
+{
+  MergedScanPublisher *m = merged_scan.load(std::memory_order_acquire);
+  if(!m->wanted())
+    return;
+
+  // laserscan was just built from c, in message order (flip already applied)
+  const size_t size = laserscan.ranges.size();
+  if(beam_cos.size() != size || beam_table_increment != laserscan.angle_increment)
+  {
+    beam_cos.resize(size);
+    beam_sin.resize(size);
+    for(size_t i = 0; i < size; ++i)
+    {
+      const double a = mount_th + laserscan.angle_min + i * laserscan.angle_increment;
+      beam_cos[i] = cos(a);
+      beam_sin[i] = sin(a);
+    }
+    beam_table_increment = laserscan.angle_increment;
+  }
+
+  merged_xy.resize(2 * size);
+  size_t n = 0;
+  for(size_t i = 0; i < size; ++i)
+  {
+    // Skip ignored readings, and no-return beams, which convertRanges()
+    // clamped to the laser's maximum range.
+    const float r = laserscan.ranges[i];
+    if(r <= 0 || r >= (float)scan_builder.range_max)
+      continue;
+    merged_xy[n++] = mount_x + r * beam_cos[i];
+    merged_xy[n++] = mount_y + r * beam_sin[i];
+  }
+  m->addScan(merged_index, c.time, merged_xy.data(), n / 2, sensor_z);
+}
+
+void LaserPublisher::publishCumulativeDelta(const LaserCapture& c)
+{
+  LatencyScope timer(cumulative_latency);
+  cumulative_alloc_check.begin();
+
+  // Send a keyframe every cumulative_keyframe_interval messages, and
+  // whenever a new subscriber might be waiting for one.
+  const uint32_t subscribers = cumulative_pub.getNumSubscribers();
+  const bool keyframe = (cumulative_since_keyframe == 0 || subscribers > cumulative_subscribers);
+  cumulative_subscribers = subscribers;
+
+  // Compare the sorted buffer with what was sent last time. The buffer can
+  // hold the same point more than once, the differences keep count.
+  cumulative_diff.assign(c.cumulative.begin(), c.cumulative.end());
+  std::sort(cumulative_diff.begin(), cumulative_diff.end());
+  cumulative_delta.added.clear();
+  cumulative_delta.removed.clear();
+  if(keyframe)
+  {
+    for(size_t i = 0; i < cumulative_diff.size(); ++i)
+      appendCumulativePoint(cumulative_delta.added, cumulative_diff[i]);
+  }
+  else
+  {
+    std::vector<uint64_t>::const_iterator cur = cumulative_diff.begin(), sent = cumulative_sent.begin();
+    while(cur != cumulative_diff.end() || sent != cumulative_sent.end())
+    {
+      if(sent == cumulative_sent.end() || (cur != cumulative_diff.end() && *cur < *sent))
+        appendCumulativePoint(cumulative_delta.added, *cur++);
+      else if(cur == cumulative_diff.end() || *sent < *cur)
+        appendCumulativePoint(cumulative_delta.removed, *sent++);
+      else
+      {
+        ++cur;
+        ++sent;
+      }
+    }
+  }
+  cumulative_sent.swap(cumulative_diff);
+
+  cumulative_alloc_check.end();
+
+  // Nothing to send if the buffer didn't change
+  if(!keyframe && cumulative_delta.added.empty() && cumulative_delta.removed.empty())
+    return;
+  cumulative_delta.header.stamp = convertArTimeToROS(c.time);
+  cumulative_delta.keyframe = keyframe;
+  ++cumulative_delta.sequence;
+  cumulative_pub.publish(cumulative_delta);
+
+  // Only messages actually sent count towards the next keyframe, and any
+  // keyframe starts the count again.
+  cumulative_since_keyframe = keyframe ? 1 : cumulative_since_keyframe + 1;
+  if(cumulative_since_keyframe >= cumulative_keyframe_interval.load(std::memory_order_relaxed))
+    cumulative_since_keyframe = 0;
+}
@@ -0,0 +1,56 @@
+#include "rosarnl/LaserScanBuilder.h"
+#include "rosarnl/RangeConversion.h"
+
+#include <math.h>
+
+void LaserScanBuilder::build(const uint32_t *mm, const uint32_t *ignore_mask, size_t n, bool flipped,
+                             const int *intensities, size_t n_intensities, double scan_time,
+                             sensor_msgs::LaserScan& scan) const
+{
+  // Spacing of the readings as captured; decimation scales it below.
+  scan.angle_min = angle_min;
+  if(n > 1)
+    scan.angle_increment = (angle_max - angle_min) / (n - 1);
+  else
+    scan.angle_increment = angle_increment;
+
+  // Scale to m, mark ignored readings with -1, and reverse the data if the
+  // laser is mounted upside down.
+  scan.ranges.resize(n);
+  convertRanges(mm, ignore_mask, n, flipped, 0, range_max, scan.ranges.data());
+
+  scan.intensities.resize(n_intensities);
+  for(size_t i = 0; i < n_intensities; ++i)
+    scan.intensities[flipped ? n_intensities - 1 - i : i] = intensities[i];
+
+  if(crop_min > 0 || crop_max > 0)
+  {
+    for(size_t i = 0; i < n; ++i)
+    {
+      const float r = scan.ranges[i];
+      if(r >= 0 && (r < crop_min || (crop_max > 0 && r > crop_max)))
+        scan.ranges[i] = -1;
+    }
+  }
+
+  if(decimation > 1)
+  {
+    const size_t kept = (n + decimation - 1) / decimation;
+    for(size_t i = 1; i < kept; ++i)
+      scan.ranges[i] = scan.ranges[i * decimation];
+    scan.ranges.resize(kept);
+    if(!scan.intensities.empty())
+    {
+      for(size_t i = 1; i < kept; ++i)
+        scan.intensities[i] = scan.intensities[i * decimation];
+      scan.intensities.resize(kept);
+    }
+    scan.angle_increment *= decimation;
+  }
+  scan.angle_max = scan.angle_min + (scan.ranges.size() > 0 ? scan.ranges.size() - 1 : 0) * scan.angle_increment;
+
+  // Assume a rotating mirror that sweeps a full turn per scan, reading
+  // angle_increment apart.
+  scan.scan_time = scan_time;
+  scan.time_increment = scan_time * scan.angle_increment / (2.0 * M_PI);
+}
@@ -0,0 +1,77 @@
+#include "rosarnl/LatencyHistogram.h"
+
+#include <algorithm>
+
+LatencyHistogram::LatencyHistogram(const std::string& _name) :
+  name(_name),
+  max_ns(0)
+{
+  for(int i = 0; i < NumBuckets; ++i)
+    buckets[i].store(0, std::memory_order_relaxed);
+  LatencyRegistry::instance().add(this);
+}
+
+LatencyHistogram::~LatencyHistogram()
+{
+  LatencyRegistry::instance().remove(this);
+}
+
+LatencyHistogram::Summary LatencyHistogram::takeSummary()
+{
+  // Values recorded while this runs may land in either summary; that is fine
+  // for monitoring.
+  uint64_t counts[NumBuckets];
+  uint64_t total = 0;
+  for(int i = 0; i < NumBuckets; ++i)
+  {
+    counts[i] = buckets[i].exchange(0, std::memory_order_relaxed);
+    total += counts[i];
+  }
+  const uint64_t max = max_ns.exchange(0, std::memory_order_relaxed);
+
+  Summary s;
+  s.count = total;
+  s.p50_ms = s.p99_ms = 0;
+  s.max_ms = max / 1.0e6;
+  if(total == 0)
+    return s;
+
+  const uint64_t rank50 = (total * 50 + 99) / 100;
+  const uint64_t rank99 = (total * 99 + 99) / 100;
+  uint64_t seen = 0;
+  bool have50 = false;
+  for(int i = 0; i < NumBuckets; ++i)
+  {
+    seen += counts[i];
+    if(!have50 && seen >= rank50)
+    {
+      s.p50_ms = std::min(bucketUpperBound(i), max) / 1.0e6;
+      have50 = true;
+    }
+    if(seen >= rank99)
+    {
+      s.p99_ms = std::min(bucketUpperBound(i), max) / 1.0e6;
+      break;
+    }
+  }
+  return s;
+}
+
+
+LatencyRegistry& LatencyRegistry::instance()
+{
+  static LatencyRegistry registry;
+  return registry;
+}
+
+void LatencyRegistry::add(LatencyHistogram *h)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  histograms.push_back(h);
+}
+
+void LatencyRegistry::remove(LatencyHistogram *h)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  histograms.erase(std::remove(histograms.begin(), histograms.end(), h), histograms.end());
+}
@@ -0,0 +1,203 @@
+#include "Aria.h"
+#include "rosarnl/MergedScanPublisher.h"
+
+#include "rosarnl/ArTimeToROSTime.h"
+
+#include <algorithm>
+#include <limits>
+#include <math.h>
+#include <string.h>
+#include <utility>
+
+MergedScanPublisher::MergedScanPublisher(ros::NodeHandle& n, const std::string& base_frame, double merge_window, double resolution_deg) :
+  merge_window_ms((long)(merge_window * 1000.0))
+{
+  ros::SubscriberStatusCallback subscribers_cb = boost::bind(&MergedScanPublisher::subscribersChanged, this, _1);
+  scan_pub = n.advertise<sensor_msgs::LaserScan>("merged_scan", 20, subscribers_cb, subscribers_cb);
+  cloud_pub = n.advertise<sensor_msgs::PointCloud2>("merged_cloud", 20, subscribers_cb, subscribers_cb);
+
+  // Full turn, empty bins are +inf (no return).
+  if(resolution_deg <= 0)
+    resolution_deg = 0.5;
+  scan.header.frame_id = base_frame;
+  // Bins are centred on angle_min + k * angle_increment and the last one
+  // stops short of +pi, which is the same direction as angle_min. Counted
+  // from the double increment: angle_increment is a float, and 2pi over it
+  // comes out just above a whole number for most resolutions.
+  const double increment = ArMath::degToRad(resolution_deg);
+  const size_t bins = (size_t) ceil(2.0 * M_PI / increment - 1e-6);
+  scan.angle_increment = increment;
+  scan.angle_min = -M_PI;
+  scan.angle_max = -M_PI + (bins - 1) * scan.angle_increment;
+  scan.range_min = 0;
+  scan.range_max = 0;
+  scan.time_increment = 0;
+  scan.scan_time = 0;
+  scan.ranges.reserve(bins);
+
+  cloud.header.frame_id = base_frame;
+  cloud.height = 1;
+  cloud.is_bigendian = false;
+  cloud.is_dense = true;
+  cloud.point_step = 3 * sizeof(float);
+  cloud.fields.resize(3);
+  const char *field_names[3] = { "x", "y", "z" };
+  for(size_t i = 0; i < 3; ++i)
+  {
+    cloud.fields[i].name = field_names[i];
+    cloud.fields[i].offset = i * sizeof(float);
+    cloud.fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+    cloud.fields[i].count = 1;
+  }
+}
+
+size_t MergedScanPublisher::addLaser(const std::string& name, double max_range, size_t max_points)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  std::lock_guard<std::mutex> publish_lock(publish_mutex);
+  ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: Merging scans from laser %s", name.c_str());
+  Slot s;
+  s.valid = false;
+  s.z = 0;
+  s.xy.reserve(2 * max_points);
+  slots.push_back(s);
+  merge_set.push_back(std::move(s));
+  scan.range_max = std::max(scan.range_max, (float)max_range);
+  cloud.data.reserve(cloud.data.capacity() + max_points * cloud.point_step);
+  return slots.size() - 1;
+}
+
+bool MergedScanPublisher::wanted() const
+{
+  return scan_pub.getNumSubscribers() > 0 || cloud_pub.getNumSubscribers() > 0;
+}
+
+void MergedScanPublisher::addSubscriberChangeCB(const boost::function<void()>& cb)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  subscriber_change_cbs.push_back(cb);
+}
+
+void MergedScanPublisher::subscribersChanged(const ros::SingleSubscriberPublisher&)
+{
+  // The lasers only process readings while something wants them
+  std::vector< boost::function<void()> > cbs;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    cbs = subscriber_change_cbs;
+  }
+  for(size_t i = 0; i < cbs.size(); ++i)
+    cbs[i]();
+}
+
+void MergedScanPublisher::addScan(size_t index, const ArTime& time, const float *xy, size_t npoints, float z)
+{
+  std::unique_lock<std::mutex> publish_lock;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    assert(index < slots.size());
+    Slot& s = slots[index];
+    s.xy.assign(xy, xy + 2 * npoints);
+    s.time = time;
+    s.z = z;
+    s.valid = true;
+
+    // Drop the older of two scans that are too far apart to be merged, and
+    // wait until every laser has one.
+    for(size_t i = 0; i < slots.size(); ++i)
+    {
+      if(!slots[i].valid)
+        return;
+      if(fabs(ariaDeltaSec(slots[i].time, time)) * 1000.0 > merge_window_ms)
+      {
+        (slots[i].time.isAfter(time) ? s : slots[i]).valid = false;
+        return;
+      }
+    }
+
+    // If the previous set is still being published, leave this one in place
+    // for the next scan to arrive to complete.
+    publish_lock = std::unique_lock<std::mutex>(publish_mutex, std::try_to_lock);
+    if(!publish_lock.owns_lock())
+      return;
+    for(size_t i = 0; i < slots.size(); ++i)
+    {
+      merge_set[i].time = slots[i].time;
+      merge_set[i].z = slots[i].z;
+      merge_set[i].xy.swap(slots[i].xy);
+      slots[i].valid = false;
+    }
+  }
+
+  publishMerged();
+}
+
+void MergedScanPublisher::publishMerged()
+{
+  LatencyScope timer(latency);
+  alloc_check.begin();
+
+  // Stamp with the newest scan in the set.
+  ArTime newest = merge_set[0].time;
+  size_t npoints = 0;
+  for(size_t i = 0; i < merge_set.size(); ++i)
+  {
+    if(merge_set[i].time.isAfter(newest))
+      newest = merge_set[i].time;
+    npoints += merge_set[i].xy.size() / 2;
+  }
+  const ros::Time stamp = convertArTimeToROS(newest);
+
+  const bool publish_scan = scan_pub.getNumSubscribers() > 0;
+  const bool publish_cloud = cloud_pub.getNumSubscribers() > 0;
+
+  // Closest point in each angular bin
+  const size_t bins = (size_t) lrint((scan.angle_max - scan.angle_min) / scan.angle_increment) + 1;
+  if(publish_scan)
+  {
+    scan.header.stamp = stamp;
+    scan.ranges.assign(bins, std::numeric_limits<float>::infinity());
+    for(size_t i = 0; i < merge_set.size(); ++i)
+    {
+      const std::vector<float>& xy = merge_set[i].xy;
+      for(size_t p = 0; p + 1 < xy.size(); p += 2)
+      {
+        const float r = hypotf(xy[p], xy[p+1]);
+        // Nearest bin centre; angles past the last bin wrap around to the
+        // first one.
+        long bin = lrint((atan2f(xy[p+1], xy[p]) - scan.angle_min) / scan.angle_increment);
+        if(bin >= (long)bins)
+          bin -= bins;
+        else if(bin < 0)
+          bin += bins;
+        scan.ranges[bin] = std::min(scan.ranges[bin], r);
+      }
+    }
+  }
+
+  if(publish_cloud)
+  {
+    cloud.header.stamp = stamp;
+    cloud.width = npoints;
+    cloud.row_step = cloud.width * cloud.point_step;
+    cloud.data.resize(cloud.row_step);
+    unsigned char *out = cloud.data.data();
+    for(size_t i = 0; i < merge_set.size(); ++i)
+    {
+      const std::vector<float>& xy = merge_set[i].xy;
+      for(size_t p = 0; p + 1 < xy.size(); p += 2)
+      {
+        const float xyz[3] = { xy[p], xy[p+1], merge_set[i].z };
+        memcpy(out, xyz, sizeof(xyz));
+        out += sizeof(xyz);
+      }
+    }
+  }
+
+  alloc_check.end();
+
+  if(publish_scan)
+    scan_pub.publish(scan);
+  if(publish_cloud)
+    cloud_pub.publish(cloud);
+}
@@ -0,0 +1,48 @@
+#include "rosarnl/PoseExtrapolator.h"
+
+#include <cmath>
+
+void PoseExtrapolator::addSample(const PoseSample& s)
+{
+  history.add(s);
+}
+
+bool PoseExtrapolator::poseAt(double t, double max_extrapolation, PoseSample& out) const
+{
+  PoseSample newest;
+  if(!history.latest(newest))
+    return false;
+  if(t <= newest.t)
+    return history.interpolate(t, out);
+  const double dt = t - newest.t;
+  if(dt > max_extrapolation)
+    return false;
+  out = extrapolate(newest, dt);
+  return true;
+}
+
+PoseSample PoseExtrapolator::extrapolate(const PoseSample& s, double dt)
+{
+  // Displacement in the frame of s for a constant body frame twist
+  // (vx, vy, wz) held for dt.
+  double dx, dy;
+  const double a = s.wz * dt;
+  if(std::fabs(a) < 1e-9)
+  {
+    dx = s.vx * dt;
+    dy = s.vy * dt;
+  }
+  else
+  {
+    const double sa = std::sin(a), ca = std::cos(a);
+    dx = (s.vx * sa + s.vy * (ca - 1.0)) / s.wz;
+    dy = (s.vx * (1.0 - ca) + s.vy * sa) / s.wz;
+  }
+  const double st = std::sin(s.th), ct = std::cos(s.th);
+  PoseSample p = s;
+  p.t = s.t + dt;
+  p.x = s.x + ct * dx - st * dy;
+  p.y = s.y + st * dx + ct * dy;
+  p.th = std::remainder(s.th + a, 2.0 * M_PI);
+  return p;
+}
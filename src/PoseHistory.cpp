@@ -0,0 +1,169 @@
+#include "rosarnl/PoseHistory.h"
+
+#include <algorithm>
+#include <cmath>
+
+PoseHistory::PoseHistory() :
+  written(0),
+  first(0),
+  newest_t(0)
+{
+  for(size_t i = 0; i < Capacity; ++i)
+  {
+    slots[i].seq.store(0, std::memory_order_relaxed);
+    slots[i].n.store((size_t)-1, std::memory_order_relaxed);
+  }
+}
+
+void PoseHistory::add(const PoseSample& s)
+{
+  const size_t w = written.load(std::memory_order_relaxed);
+  if(w > first.load(std::memory_order_relaxed) && s.t <= newest_t)
+  {
+    if(s.t == newest_t)
+      return;
+    // Older samples are on the old time line and would never be replaced,
+    // as nothing after this one is newer than them. Readers see the clear
+    // no later than the sample below (release on written).
+    first.store(w, std::memory_order_relaxed);
+  }
+  newest_t = s.t;
+
+  Slot& slot = slots[w % Capacity];
+  const unsigned long q = slot.seq.load(std::memory_order_relaxed);
+  slot.seq.store(q + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.n.store(w, std::memory_order_relaxed);
+  slot.t.store(s.t, std::memory_order_relaxed);
+  slot.x.store(s.x, std::memory_order_relaxed);
+  slot.y.store(s.y, std::memory_order_relaxed);
+  slot.th.store(s.th, std::memory_order_relaxed);
+  slot.vx.store(s.vx, std::memory_order_relaxed);
+  slot.vy.store(s.vy, std::memory_order_relaxed);
+  slot.wz.store(s.wz, std::memory_order_relaxed);
+  slot.seq.store(q + 2, std::memory_order_release);
+
+  written.store(w + 1, std::memory_order_release);
+}
+
+bool PoseHistory::read(size_t n, PoseSample& out) const
+{
+  const Slot& slot = slots[n % Capacity];
+  for(;;)
+  {
+    const unsigned long q = slot.seq.load(std::memory_order_acquire);
+    if(q & 1)
+      continue; // write in progress
+    const size_t held = slot.n.load(std::memory_order_relaxed);
+    out.t = slot.t.load(std::memory_order_relaxed);
+    out.x = slot.x.load(std::memory_order_relaxed);
+    out.y = slot.y.load(std::memory_order_relaxed);
+    out.th = slot.th.load(std::memory_order_relaxed);
+    out.vx = slot.vx.load(std::memory_order_relaxed);
+    out.vy = slot.vy.load(std::memory_order_relaxed);
+    out.wz = slot.wz.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(slot.seq.load(std::memory_order_relaxed) == q)
+      return held == n;
+  }
+}
+
+bool PoseHistory::latest(PoseSample& out) const
+{
+  // The newest sample can only be overwritten after Capacity more adds, so
+  // retrying here never spins for long.
+  for(;;)
+  {
+    const size_t w = written.load(std::memory_order_acquire);
+    if(w <= first.load(std::memory_order_relaxed))
+      return false;
+    if(read(w - 1, out))
+      return true;
+  }
+}
+
+static double interpolateAngle(double a, double b, double f)
+{
+  return a + f * std::remainder(b - a, 2.0 * M_PI);
+}
+
+bool PoseHistory::tryInterpolate(double t, PoseSample& out, bool& retry) const
+{
+  retry = false;
+  const size_t w = written.load(std::memory_order_acquire);
+  const size_t oldest = first.load(std::memory_order_relaxed);
+  if(w <= oldest)
+    return false;  // empty, or cleared and the next sample not yet added
+
+  // Sample numbers lo..hi are in the ring. Leave the oldest slot out, it is
+  // the next one to be overwritten.
+  size_t lo = std::max(oldest, (w > Capacity - 1) ? w - (Capacity - 1) : 0);
+  size_t hi = w - 1;
+  PoseSample a, b;
+  if(!read(hi, b))
+  {
+    retry = true;
+    return false;
+  }
+  if(t > b.t)
+    return false;
+  if(t == b.t || lo == hi)
+  {
+    out = b;
+    return t == b.t;
+  }
+  if(!read(lo, a))
+  {
+    retry = true;
+    return false;
+  }
+  if(t < a.t)
+    return false;
+
+  // Invariant: a (sample lo) is at or before t, b (sample hi) after it.
+  while(hi - lo > 1)
+  {
+    const size_t mid = lo + (hi - lo) / 2;
+    PoseSample m;
+    if(!read(mid, m))
+    {
+      retry = true;
+      return false;
+    }
+    if(m.t <= t)
+    {
+      lo = mid;
+      a = m;
+    }
+    else
+    {
+      hi = mid;
+      b = m;
+    }
+  }
+
+  const double f = (t - a.t) / (b.t - a.t);
+  out.t = t;
+  out.x = a.x + f * (b.x - a.x);
+  out.y = a.y + f * (b.y - a.y);
+  out.th = interpolateAngle(a.th, b.th, f);
+  out.vx = a.vx + f * (b.vx - a.vx);
+  out.vy = a.vy + f * (b.vy - a.vy);
+  out.wz = a.wz + f * (b.wz - a.wz);
+  return true;
+}
+
+bool PoseHistory::interpolate(double t, PoseSample& out) const
+{
+  // A retry is only needed if the reader was held up for about a ring's
+  // worth of robot cycles, so a couple of attempts is plenty.
+  for(int attempt = 0; attempt < 3; ++attempt)
+  {
+    bool retry;
+    if(tryInterpolate(t, out, retry))
+      return true;
+    if(!retry)
+      return false;
+  }
+  return false;
+}
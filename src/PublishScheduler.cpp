@@ -0,0 +1,126 @@
+#include "rosarnl/PublishScheduler.h"
+
+#include <algorithm>
+#include <functional>
+
+// How long to sleep when there is nothing scheduled (all streams disabled).
+// Disabled streams are polled at this interval for rate changes.
+static const std::chrono::milliseconds IdlePeriod(100);
+
+PublishScheduler::PublishScheduler() :
+  started(false),
+  rates_changed(false)
+{
+}
+
+long long PublishScheduler::rateToPeriod(double rate)
+{
+  if(rate <= 0)
+    return 0;
+  return (long long)(1.0e9 / rate);
+}
+
+int PublishScheduler::addStream(const std::string& name, double rate, const boost::function<void()>& fn)
+{
+  std::unique_ptr<Stream> s(new Stream);
+  s->name = name;
+  s->fn = fn;
+  s->period_ns = rateToPeriod(rate);
+  s->rate_changed = false;
+  s->emitted = 0;
+  s->missed = 0;
+  streams.push_back(std::move(s));
+  heap.reserve(streams.size());
+  return (int)streams.size() - 1;
+}
+
+void PublishScheduler::setRate(int id, double rate)
+{
+  Stream& s = *streams[id];
+  const long long period_ns = rateToPeriod(rate);
+  if(s.period_ns.exchange(period_ns) == period_ns)
+    return;
+  s.rate_changed.store(true, std::memory_order_release);
+  rates_changed.store(true, std::memory_order_release);
+}
+
+void PublishScheduler::applyRateChanges(Clock::time_point now)
+{
+  if(!rates_changed.exchange(false, std::memory_order_acquire))
+    return;
+  bool moved = false;
+  for(size_t i = 0; i < heap.size(); ++i)
+  {
+    Stream& s = *streams[heap[i].id];
+    if(!s.rate_changed.exchange(false, std::memory_order_acquire))
+      continue;
+    const long long period_ns = s.period_ns;
+    if(period_ns <= 0)
+      heap[i].when = now + IdlePeriod;
+    else if(s.emitted == 0)
+      heap[i].when = now;
+    else
+      heap[i].when = std::max(now, s.last_run + Clock::duration(std::chrono::nanoseconds(period_ns)));
+    moved = true;
+  }
+  if(moved)
+    std::make_heap(heap.begin(), heap.end(), std::greater<Deadline>());
+}
+
+PublishScheduler::Clock::time_point PublishScheduler::runDue(Clock::time_point now)
+{
+  const std::greater<Deadline> cmp;
+
+  if(!started)
+  {
+    // Everything is due immediately the first time.
+    for(size_t i = 0; i < streams.size(); ++i)
+    {
+      Deadline d = { now, (int)i };
+      heap.push_back(d);
+    }
+    std::make_heap(heap.begin(), heap.end(), cmp);
+    started = true;
+  }
+  else
+    applyRateChanges(now);
+
+  while(!heap.empty() && heap.front().when <= now)
+  {
+    std::pop_heap(heap.begin(), heap.end(), cmp);
+    Deadline d = heap.back();
+    heap.pop_back();
+
+    Stream& s = *streams[d.id];
+    const long long period_ns = s.period_ns;
+    if(period_ns <= 0)
+    {
+      // disabled, check again later
+      d.when = now + IdlePeriod;
+    }
+    else
+    {
+      s.fn();
+      ++s.emitted;
+      s.last_run = d.when;
+
+      // Next deadline is one period after this one, not after now, so the
+      // average rate stays exact. If we are more than a period late, skip
+      // ahead instead of catching up with a burst.
+      const Clock::duration period = std::chrono::nanoseconds(period_ns);
+      d.when += period;
+      if(d.when <= now)
+      {
+        const long long behind = (now - d.when) / period + 1;
+        s.missed += behind;
+        d.when += behind * period;
+      }
+    }
+    heap.push_back(d);
+    std::push_heap(heap.begin(), heap.end(), cmp);
+  }
+
+  if(heap.empty())
+    return now + IdlePeriod;
+  return heap.front().when;
+}
@@ -0,0 +1,104 @@
+#include "rosarnl/RangeConversion.h"
+
+#include <algorithm>
+#include <math.h>
+
+namespace {
+
+// Bit j of an ignore mask word. Testing against a table entry rather than
+// shifting by j keeps the loops below vectorizable without per-lane variable
+// shifts, which SSE2 doesn't have.
+const uint32_t bit[32] = {
+  1u<<0,  1u<<1,  1u<<2,  1u<<3,  1u<<4,  1u<<5,  1u<<6,  1u<<7,
+  1u<<8,  1u<<9,  1u<<10, 1u<<11, 1u<<12, 1u<<13, 1u<<14, 1u<<15,
+  1u<<16, 1u<<17, 1u<<18, 1u<<19, 1u<<20, 1u<<21, 1u<<22, 1u<<23,
+  1u<<24, 1u<<25, 1u<<26, 1u<<27, 1u<<28, 1u<<29, 1u<<30, 1u<<31
+};
+
+// One reading. Written as selects rather than if/else so that it vectorizes.
+inline float convertRange(uint32_t mm, uint32_t ignored, float range_min, float range_max)
+{
+  const float r = std::min(std::max((float)mm * 0.001f, range_min), range_max);
+  return ignored ? -1.0f : r;
+}
+
+// Convert up to 32 readings covered by one mask word. Output index j goes to
+// out[j * step], step is +1 or -1.
+template<int step>
+inline void convertBlock(const uint32_t *mm, uint32_t mask, size_t count, float range_min, float range_max, float *out)
+{
+  if(count == 32)
+  {
+    // fixed trip count, the common case
+    for(size_t j = 0; j < 32; ++j)
+      out[step * (ptrdiff_t)j] = convertRange(mm[j], mask & bit[j], range_min, range_max);
+  }
+  else
+  {
+    for(size_t j = 0; j < count; ++j)
+      out[step * (ptrdiff_t)j] = convertRange(mm[j], mask & bit[j], range_min, range_max);
+  }
+}
+
+}
+
+void convertRanges(const uint32_t *mm, const uint32_t *ignore_mask, size_t n, bool flipped, float range_min, float range_max, float *out)
+{
+  for(size_t i = 0; i < n; i += 32)
+  {
+    const size_t count = std::min<size_t>(32, n - i);
+    if(flipped)
+      convertBlock<-1>(mm + i, ignore_mask[i >> 5], count, range_min, range_max, out + n - 1 - i);
+    else
+      convertBlock<1>(mm + i, ignore_mask[i >> 5], count, range_min, range_max, out + i);
+  }
+}
+
+size_t encodeCompactRanges(const float *ranges, size_t n, uint8_t *out)
+{
+  uint8_t *p = out;
+  int32_t prev = 0;
+  for(size_t i = 0; i < n; ++i)
+  {
+    // 1..65534 mm, 0 for no reading, 65535 if further
+    const float r = ranges[i];
+    int32_t mm = 0;
+    if(r > 0)
+      mm = (r * 1000.0f < 65534.5f) ? std::max((int32_t)lrintf(r * 1000.0f), (int32_t)1) : 65535;
+    const int32_t d = mm - prev;
+    prev = mm;
+    uint32_t z = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+    while(z >= 0x80)
+    {
+      *p++ = (uint8_t)(z | 0x80);
+      z >>= 7;
+    }
+    *p++ = (uint8_t)z;
+  }
+  return p - out;
+}
+
+bool decodeCompactRanges(const uint8_t *data, size_t bytes, size_t count, uint16_t *mm)
+{
+  const uint8_t *p = data;
+  const uint8_t *end = data + bytes;
+  int32_t prev = 0;
+  for(size_t i = 0; i < count; ++i)
+  {
+    uint32_t z = 0;
+    for(int shift = 0; ; shift += 7)
+    {
+      if(p == end || shift > 14)
+        return false;
+      const uint8_t b = *p++;
+      z |= (uint32_t)(b & 0x7f) << shift;
+      if(!(b & 0x80))
+        break;
+    }
+    prev += (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+    if(prev < 0 || prev > 65535)
+      return false;
+    mm[i] = (uint16_t)prev;
+  }
+  return p == end;
+}
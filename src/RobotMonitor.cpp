@@ -17,7 +17,8 @@ RobotMonitor::RobotMonitor(ArRobot *r, ArServerHandlerPopup *ps) :
     "Ignore", "Ignore"
   ),
   handleMotorsDisabledPopupResponseCB(this, &RobotMonitor::handleMotorsDisabledResponse),
-  robotMonitorCB(this, &RobotMonitor::robotMonitorTask)
+  robotMonitorCB(this, &RobotMonitor::robotMonitorTask),
+  taskLatency("RobotMonitor::robotMonitorTask")
 {
   wheelLightDefault = true;
   robot->addUserTask("arnlServerRobotMonitor", 30, &robotMonitorCB);
@@ -44,6 +45,7 @@ void RobotMonitor::handleMotorsDisabledResponse(ArTypes::Byte4 popupID, int butt
 // state and perform feedback and interact with user as needed.
 void RobotMonitor::robotMonitorTask()
 {
+  LatencyScope timer(taskLatency);
 
   // a way for user to re-enable motors if disabled -- show a popup dialog in
   // MobileEyes.
@@ -0,0 +1,49 @@
+#include "rosarnl/RobotStateNotifier.h"
+
+#include <chrono>
+
+RobotStateNotifier::RobotStateNotifier() :
+  have_last(false),
+  pending_changes(0)
+{
+}
+
+void RobotStateNotifier::update(const RobotStateSnapshot& snap)
+{
+  unsigned int changes = 0;
+  if(!have_last)
+  {
+    changes = MotorsChanged | EStopChanged | DockStateChanged | ChargeStateChanged;
+    have_last = true;
+  }
+  else
+  {
+    if(snap.motorsEnabled != last.motorsEnabled) changes |= MotorsChanged;
+    if(snap.estop != last.estop) changes |= EStopChanged;
+    if(snap.dockState != last.dockState) changes |= DockStateChanged;
+    if(snap.chargeState != last.chargeState) changes |= ChargeStateChanged;
+  }
+
+  if(changes == 0)
+    return;
+
+  last = snap;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    state = snap;
+  }
+  pending_changes.fetch_or(changes);
+  cond.notify_all();
+}
+
+bool RobotStateNotifier::waitFor(const boost::function<bool(const RobotStateSnapshot&)>& pred, double timeout)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  return cond.wait_for(lock, std::chrono::duration<double>(timeout), [&] { return pred(state); });
+}
+
+RobotStateSnapshot RobotStateNotifier::getState() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return state;
+}
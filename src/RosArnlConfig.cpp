@@ -0,0 +1,264 @@
+#include "rosarnl/RosArnlConfig.h"
+
+#include <tf/tf.h>
+
+// Like NodeHandle::param(), but through roscpp's parameter cache: the first
+// read subscribes to the parameter and the master then pushes any change to
+// it, so later loads are local and can be repeated cheaply to detect changes.
+template<class T, class D>
+static void cachedParam(ros::NodeHandle& n, const std::string& name, T& value, const D& def)
+{
+  if(!n.getParamCached(name, value))
+    value = def;
+}
+
+// A rate of 0 disables an output; negative rates are rejected.
+static void checkRate(const char *name, double& rate, double def)
+{
+  if(rate < 0)
+  {
+    ROS_WARN_NAMED("rosarnl_node", "rosarnl_node: %s must not be negative, using %g Hz.", name, def);
+    rate = def;
+  }
+  else if(rate == 0)
+    ROS_WARN_NAMED("rosarnl_node", "rosarnl_node: %s is 0, that output is disabled.", name);
+}
+
+// Times and limits where 0 is meaningful but negative values are not.
+static void checkNotNegative(const char *name, double& value, double def, const char *unit)
+{
+  if(value < 0)
+  {
+    ROS_WARN_NAMED("rosarnl_node", "rosarnl_node: %s must not be negative, using %g %s.", name, def, unit);
+    value = def;
+  }
+}
+
+RosArnlConfig RosArnlConfig::read(ros::NodeHandle& n, const RosArnlConfig *previous)
+{
+  RosArnlConfig c;
+
+  cachedParam(n, "use_covariance", c.use_covariance, false);
+  cachedParam(n, "covariance_rate", c.covariance_rate, 2.0);
+
+  cachedParam(n, "pose_rate", c.pose_rate, 10.0);
+  cachedParam(n, "tf_rate", c.tf_rate, 10.0);
+  cachedParam(n, "feedback_rate", c.feedback_rate, 10.0);
+  cachedParam(n, "state_rate", c.state_rate, 10.0);
+  cachedParam(n, "extrapolated_pose_rate", c.extrapolated_pose_rate, 50.0);
+  cachedParam(n, "pose_extrapolation_limit", c.pose_extrapolation_limit, 0.5);
+  cachedParam(n, "transform_tolerance", c.transform_tolerance, 0.1);
+
+  cachedParam(n, "motion_threads", c.motion_threads, 1);
+  cachedParam(n, "action_threads", c.action_threads, 1);
+  cachedParam(n, "admin_threads", c.admin_threads, 2);
+  cachedParam(n, "diagnostics_threads", c.diagnostics_threads, 1);
+
+  cachedParam(n, "battery_period", c.battery_period, 5.0);
+
+  cachedParam(n, "cmd_vel_timeout", c.cmd_vel_timeout, 0.6);
+
+  cachedParam(n, "diagnostics_rate", c.diagnostics_rate, 1.0);
+  cachedParam(n, "clock_sync_rate", c.clock_sync_rate, 1.0);
+
+  cachedParam(n, "merged_scan", c.merged_scan, false);
+  cachedParam(n, "merged_scan_window", c.merged_scan_window, 0.1);
+  cachedParam(n, "merged_scan_resolution", c.merged_scan_resolution, 0.5);
+
+  cachedParam(n, "link_quality_full_rate", c.link_quality_full_rate, 0);
+  cachedParam(n, "max_scan_skip", c.max_scan_skip, 9);
+
+  cachedParam(n, "cumulative_keyframe_interval", c.cumulative_keyframe_interval, 20);
+
+  // Figure out what frame_id's to use. if a tf_prefix param is specified,
+  // it will be added to the beginning of the frame_ids.
+  //
+  // e.g. rosrun ... _tf_prefix:=MyRobot (or equivalently using <param>s in
+  // roslaunch files)
+  // will result in the frame_ids being set to /MyRobot/map etc,
+  // rather than /map. This is useful for Multi Robot Systems.
+  // See ROS Wiki for further details.
+  std::string map_frame, odom_frame, base_frame, bumper_frame, sonar_frame;
+  cachedParam(n, "map_frame", map_frame, "map");
+  cachedParam(n, "odom_frame", odom_frame, "odom");
+  cachedParam(n, "base_frame", base_frame, "base_link");
+  cachedParam(n, "bumper_frame", bumper_frame, "bumpers_frame");
+  cachedParam(n, "sonar_frame", sonar_frame, "sonar_frame");
+
+  // tf_prefix is looked up with searchParam(), which always goes to the
+  // master, and frames cannot change after startup anyway.
+  c.tf_prefix = previous ? previous->tf_prefix : tf::getPrefixParam(n);
+  c.frame_id_map = tf::resolve(c.tf_prefix, map_frame);
+  c.frame_id_odom = tf::resolve(c.tf_prefix, odom_frame);
+  c.frame_id_base_link = tf::resolve(c.tf_prefix, base_frame);
+  c.frame_id_bumper = tf::resolve(c.tf_prefix, bumper_frame);
+  c.frame_id_sonar = tf::resolve(c.tf_prefix, sonar_frame);
+
+  return c;
+}
+
+bool RosArnlConfig::operator==(const RosArnlConfig& o) const
+{
+  return use_covariance == o.use_covariance && covariance_rate == o.covariance_rate &&
+    pose_rate == o.pose_rate && tf_rate == o.tf_rate && feedback_rate == o.feedback_rate &&
+    state_rate == o.state_rate && extrapolated_pose_rate == o.extrapolated_pose_rate &&
+    pose_extrapolation_limit == o.pose_extrapolation_limit && transform_tolerance == o.transform_tolerance &&
+    motion_threads == o.motion_threads && action_threads == o.action_threads &&
+    admin_threads == o.admin_threads && diagnostics_threads == o.diagnostics_threads &&
+    battery_period == o.battery_period && cmd_vel_timeout == o.cmd_vel_timeout &&
+    diagnostics_rate == o.diagnostics_rate && clock_sync_rate == o.clock_sync_rate &&
+    merged_scan == o.merged_scan && merged_scan_window == o.merged_scan_window &&
+    merged_scan_resolution == o.merged_scan_resolution &&
+    link_quality_full_rate == o.link_quality_full_rate && max_scan_skip == o.max_scan_skip &&
+    cumulative_keyframe_interval == o.cumulative_keyframe_interval &&
+    tf_prefix == o.tf_prefix && frame_id_map == o.frame_id_map && frame_id_odom == o.frame_id_odom &&
+    frame_id_base_link == o.frame_id_base_link && frame_id_bumper == o.frame_id_bumper &&
+    frame_id_sonar == o.frame_id_sonar;
+}
+
+bool RosArnlConfig::sameFrames(const RosArnlConfig& o) const
+{
+  return frame_id_map == o.frame_id_map && frame_id_odom == o.frame_id_odom &&
+    frame_id_base_link == o.frame_id_base_link && frame_id_bumper == o.frame_id_bumper &&
+    frame_id_sonar == o.frame_id_sonar;
+}
+
+void RosArnlConfig::validate()
+{
+  RosArnlConfig& c = *this;
+
+  checkRate("pose_rate", c.pose_rate, 10.0);
+  checkRate("tf_rate", c.tf_rate, 10.0);
+  checkRate("feedback_rate", c.feedback_rate, 10.0);
+  checkRate("state_rate", c.state_rate, 10.0);
+  checkRate("extrapolated_pose_rate", c.extrapolated_pose_rate, 50.0);
+  checkRate("diagnostics_rate", c.diagnostics_rate, 1.0);
+
+  if(c.motion_threads < 1) c.motion_threads = 1;
+  if(c.action_threads < 1) c.action_threads = 1;
+  if(c.admin_threads < 1) c.admin_threads = 1;
+  if(c.diagnostics_threads < 1) c.diagnostics_threads = 1;
+
+  if(c.covariance_rate <= 0)
+  {
+    ROS_WARN_NAMED("rosarnl_node", "rosarnl_node: covariance_rate must be positive, using 2 Hz.");
+    c.covariance_rate = 2.0;
+  }
+
+  if(c.battery_period <= 0)
+  {
+    ROS_WARN_NAMED("rosarnl_node", "rosarnl_node: battery_period must be positive, using 5 sec.");
+    c.battery_period = 5.0;
+  }
+
+  if(c.clock_sync_rate <= 0)
+  {
+    ROS_WARN_NAMED("rosarnl_node", "rosarnl_node: clock_sync_rate must be positive, using 1 Hz.");
+    c.clock_sync_rate = 1.0;
+  }
+
+  // A negative cmd_vel_timeout would silently disable the watchdog.
+  checkNotNegative("cmd_vel_timeout", c.cmd_vel_timeout, 0.6, "sec");
+  checkNotNegative("pose_extrapolation_limit", c.pose_extrapolation_limit, 0.5, "sec");
+  checkNotNegative("transform_tolerance", c.transform_tolerance, 0.1, "sec");
+  checkNotNegative("merged_scan_window", c.merged_scan_window, 0.1, "sec");
+
+  if(c.merged_scan_resolution <= 0)
+  {
+    ROS_WARN_NAMED("rosarnl_node", "rosarnl_node: merged_scan_resolution must be positive, using 0.5 deg.");
+    c.merged_scan_resolution = 0.5;
+  }
+}
+
+RosArnlConfig RosArnlConfig::load(ros::NodeHandle& n)
+{
+  RosArnlConfig c = read(n, NULL);
+  c.validate();
+  return c;
+}
+
+
+constexpr double RosArnlConfigStore::retire_grace;
+
+RosArnlConfigStore::RosArnlConfigStore(ros::NodeHandle& _n) :
+  node(_n),
+  current(NULL)
+{
+  last_read = RosArnlConfig::read(node, NULL);
+  RosArnlConfig c = last_read;
+  c.validate();
+  current_version.reset(new RosArnlConfig(c));
+  current.store(current_version.get(), std::memory_order_release);
+  reload_srv = node.advertiseService("reload_params", &RosArnlConfigStore::reload_cb, this);
+  check_timer = node.createTimer(ros::Duration(1.0), &RosArnlConfigStore::check_cb, this);
+}
+
+void RosArnlConfigStore::reload()
+{
+  std::lock_guard<std::mutex> lock(reload_mutex);
+  last_read = RosArnlConfig::read(node, &get());
+  publish(last_read);
+}
+
+void RosArnlConfigStore::reloadIfChanged()
+{
+  std::lock_guard<std::mutex> lock(reload_mutex);
+  RosArnlConfig r = RosArnlConfig::read(node, &get());
+  if(r == last_read)
+    return;
+  last_read = r;
+  publish(r);
+}
+
+void RosArnlConfigStore::publish(RosArnlConfig c)
+{
+  const RosArnlConfig& old = get();
+  c.validate();
+  // LaserPublisher, SonarPublisher and MergedScanPublisher fix their frames
+  // (and the static sensor transforms) at startup, so frame changes would
+  // leave them inconsistent with the rest of the node.
+  if(!c.sameFrames(old))
+  {
+    ROS_WARN_NAMED("rosarnl_node", "rosarnl_node: Frame names cannot be changed while running, keeping map frame %s, base frame %s.",
+      old.frame_id_map.c_str(), old.frame_id_base_link.c_str());
+    c.frame_id_map = old.frame_id_map;
+    c.frame_id_odom = old.frame_id_odom;
+    c.frame_id_base_link = old.frame_id_base_link;
+    c.frame_id_bumper = old.frame_id_bumper;
+    c.frame_id_sonar = old.frame_id_sonar;
+  }
+  const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  Retired r;
+  r.since = now;
+  r.config = std::move(current_version);
+  retired.push_back(std::move(r));
+  current_version.reset(new RosArnlConfig(c));
+  const RosArnlConfig *n = current_version.get();
+  current.store(n, std::memory_order_release);
+
+  // Free configs that no reader can still be using.
+  const std::chrono::duration<double> grace(retire_grace);
+  while(!retired.empty() && now - retired.front().since > grace)
+    retired.pop_front();
+  ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: Reloaded parameters (use_covariance=%s, map frame %s, base frame %s)",
+    n->use_covariance?"true":"false", n->frame_id_map.c_str(), n->frame_id_base_link.c_str());
+  for(size_t i = 0; i < change_cbs.size(); ++i)
+    change_cbs[i](*n);
+}
+
+void RosArnlConfigStore::addChangeCB(const boost::function<void(const RosArnlConfig&)>& cb)
+{
+  std::lock_guard<std::mutex> lock(reload_mutex);
+  change_cbs.push_back(cb);
+}
+
+void RosArnlConfigStore::check_cb(const ros::TimerEvent& event)
+{
+  reloadIfChanged();
+}
+
+bool RosArnlConfigStore::reload_cb(std_srvs::Empty::Request& request, std_srvs::Empty::Response& response)
+{
+  reload();
+  return true;
+}
@@ -0,0 +1,48 @@
+#include "rosarnl/ScanTimeEstimator.h"
+
+// Filter gain per scan
+static const double gain = 0.1;
+
+// Intervals longer than this multiple of the estimate are treated as dropped
+// scans...
+static const double max_ratio = 1.5;
+
+// ...unless this many arrive in a row.
+static const size_t max_rejected = 5;
+
+ScanTimeEstimator::ScanTimeEstimator()
+{
+  reset();
+}
+
+void ScanTimeEstimator::reset()
+{
+  last_t = 0;
+  have_last_t = false;
+  estimate = 0;
+  rejected = 0;
+}
+
+void ScanTimeEstimator::addStamp(double t)
+{
+  if(have_last_t && t <= last_t)
+    return;
+  if(have_last_t)
+  {
+    const double dt = t - last_t;
+    if(estimate <= 0)
+      estimate = dt;
+    else if(dt < max_ratio * estimate)
+    {
+      estimate += gain * (dt - estimate);
+      rejected = 0;
+    }
+    else if(++rejected >= max_rejected)
+    {
+      estimate = dt;
+      rejected = 0;
+    }
+  }
+  last_t = t;
+  have_last_t = true;
+}
@@ -0,0 +1,187 @@
+#include "Aria.h"
+#include "rosarnl/SonarPublisher.h"
+
+#include "rosarnl/ArTimeToROSTime.h"
+
+#include <tf/tf.h>
+
+#include <sstream>
+#include <string.h>
+
+SonarPublisher::SonarPublisher(ArRobot *_robot, ros::NodeHandle& _n, tf2_ros::StaticTransformBroadcaster& _static_tf, const std::string& _base_frame, const std::string& _sonar_frame) :
+  robot(_robot),
+  sonarTaskCB(this, &SonarPublisher::sonarTask),
+  carry_updated(false),
+  publish_thread_running(false),
+  base_frame(_base_frame)
+{
+  assert(robot);
+  robot->lock();
+  num_sonar = robot->getNumSonar();
+  if(num_sonar > MaxSonar)
+  {
+    ROS_WARN_NAMED("rosarnl_node", "rosarnl_node: Robot has %d sonar transducers, only publishing the first %d.", num_sonar, (int)MaxSonar);
+    num_sonar = MaxSonar;
+  }
+
+  max_range = 5.0;
+  ArRangeDevice *dev = robot->findRangeDevice("sonar");
+  if(dev)
+    max_range = dev->getMaxRange() / 1000.0;
+
+  range_pubs.resize(num_sonar);
+  range_msgs.resize(num_sonar);
+  std::vector<geometry_msgs::TransformStamped> mounts(num_sonar);
+  const ros::Time now = ros::Time::now();
+  for(int i = 0; i < num_sonar; ++i)
+  {
+    std::stringstream topic, frame;
+    topic << "sonar_" << i;
+    frame << _sonar_frame << "_" << i;
+    range_pubs[i] = _n.advertise<sensor_msgs::Range>(topic.str(), 20);
+
+    // Transducer position from the robot parameters
+    ArSensorReading *r = robot->getSonarReading(i);
+    assert(r);
+    mounts[i].header.stamp = now;
+    mounts[i].header.frame_id = base_frame;
+    mounts[i].child_frame_id = frame.str();
+    mounts[i].transform.translation.x = r->getSensorX() / 1000.0;
+    mounts[i].transform.translation.y = r->getSensorY() / 1000.0;
+    mounts[i].transform.translation.z = 0;
+    mounts[i].transform.rotation = tf::createQuaternionMsgFromYaw(ArMath::degToRad(r->getSensorTh()));
+
+    sensor_msgs::Range& m = range_msgs[i];
+    m.header.frame_id = frame.str();
+    m.radiation_type = sensor_msgs::Range::ULTRASOUND;
+    m.field_of_view = ArMath::degToRad(15);
+    m.min_range = 0;
+    m.max_range = max_range;
+  }
+  robot->unlock();
+  if(num_sonar > 0)
+    _static_tf.sendTransform(mounts);
+
+  cloud_pub = _n.advertise<sensor_msgs::PointCloud2>("sonar_cloud", 20);
+  cloud.header.frame_id = base_frame;
+  cloud.height = 1;
+  cloud.is_bigendian = false;
+  cloud.is_dense = true;
+  cloud.point_step = 3 * sizeof(float);
+  cloud.fields.resize(3);
+  const char *field_names[3] = { "x", "y", "z" };
+  for(size_t i = 0; i < 3; ++i)
+  {
+    cloud.fields[i].name = field_names[i];
+    cloud.fields[i].offset = i * sizeof(float);
+    cloud.fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+    cloud.fields[i].count = 1;
+  }
+  cloud.data.reserve(num_sonar * cloud.point_step);
+
+  publish_thread_running = true;
+  publish_thread = std::thread(&SonarPublisher::publishThreadMain, this);
+
+  robot->lock();
+  robot->addSensorInterpTask("ROSSonarTask", 90, &sonarTaskCB);
+  robot->unlock();
+}
+
+SonarPublisher::~SonarPublisher()
+{
+  robot->lock();
+  robot->remSensorInterpTask(&sonarTaskCB);
+  robot->unlock();
+
+  {
+    std::lock_guard<std::mutex> lock(capture_mutex);
+    publish_thread_running = false;
+  }
+  capture_cond.notify_all();
+  if(publish_thread.joinable())
+    publish_thread.join();
+}
+
+void SonarPublisher::sonarTask()
+{
+  // Called from the robot thread with the robot locked, after each SIP.
+  LatencyScope timer(task_latency);
+  if(num_sonar == 0 || !robot->areSonarsEnabled())
+    return;
+
+  const unsigned int counter = robot->getCounter();
+  bool any = false;
+  SonarCapture& capture = captures.back();
+  capture.time = robot->getLastPacketTime();
+  capture.count = num_sonar;
+  for(int i = 0; i < num_sonar; ++i)
+  {
+    ArSensorReading *r = robot->getSonarReading(i);
+    const bool is_new = r->isNew(counter);
+    any = any || is_new;
+    // Keep transducers updated in a capture that was replaced before it
+    // was published.
+    capture.updated[i] = is_new || (carry_updated && capture.updated[i]);
+    capture.range[i] = r->getRange() / 1000.0;
+    capture.x[i] = r->getLocalX() / 1000.0;
+    capture.y[i] = r->getLocalY() / 1000.0;
+  }
+  if(!any)
+    return;
+
+  carry_updated = !captures.publish();
+  capture_cond.notify_one();
+}
+
+void SonarPublisher::publishThreadMain()
+{
+  while(publish_thread_running)
+  {
+    {
+      std::unique_lock<std::mutex> lock(capture_mutex);
+      // sonarTask() notifies without the mutex, so the timeout covers a
+      // notification that races with the check.
+      capture_cond.wait_for(lock, std::chrono::milliseconds(100), [this] {
+        return captures.fresh() || !publish_thread_running;
+      });
+    }
+    if(captures.take())
+      publish(captures.front());
+  }
+}
+
+void SonarPublisher::publish(const SonarCapture& c)
+{
+  LatencyScope timer(publish_latency);
+  const ros::Time stamp = convertArTimeToROS(c.time);
+
+  for(int i = 0; i < c.count; ++i)
+  {
+    if(!c.updated[i] || range_pubs[i].getNumSubscribers() == 0)
+      continue;
+    range_msgs[i].header.stamp = stamp;
+    range_msgs[i].range = c.range[i];
+    range_pubs[i].publish(range_msgs[i]);
+  }
+
+  if(cloud_pub.getNumSubscribers() > 0)
+  {
+    alloc_check.begin();
+    cloud.header.stamp = stamp;
+    cloud.data.resize(c.count * cloud.point_step);
+    unsigned char *out = cloud.data.data();
+    for(int i = 0; i < c.count; ++i)
+    {
+      if(c.range[i] >= max_range)
+        continue;
+      const float xyz[3] = { c.x[i], c.y[i], 0 };
+      memcpy(out, xyz, sizeof(xyz));
+      out += sizeof(xyz);
+    }
+    cloud.data.resize(out - cloud.data.data());
+    cloud.width = cloud.data.size() / cloud.point_step;
+    cloud.row_step = cloud.data.size();
+    alloc_check.end();
+    cloud_pub.publish(cloud);
+  }
+}
@@ -0,0 +1,46 @@
+#include "rosarnl/StateMessages.h"
+
+#include <tf/tf.h>
+
+#include <math.h>
+
+void fillPose(const RobotStateSnapshot& snap, geometry_msgs::Pose& pose)
+{
+  pose.position.x = snap.x/1000;
+  pose.position.y = snap.y/1000;
+  pose.position.z = 0.0;
+  pose.orientation = tf::createQuaternionMsgFromYaw(snap.th*M_PI/180);
+}
+
+void fillMapToOdom(const RobotStateSnapshot& snap, geometry_msgs::Transform& map_odom)
+{
+  const tf::Transform map_base(tf::createQuaternionFromYaw(snap.th*M_PI/180), tf::Vector3(snap.x/1000, snap.y/1000, 0));
+  const tf::Transform odom_base(tf::createQuaternionFromYaw(snap.encTh*M_PI/180), tf::Vector3(snap.encX/1000, snap.encY/1000, 0));
+  tf::transformTFToMsg(map_base * odom_base.inverse(), map_odom);
+}
+
+void fillOdometry(const RobotStateSnapshot& snap, geometry_msgs::Transform& odom_base, nav_msgs::Odometry& odom)
+{
+  const geometry_msgs::Quaternion q = tf::createQuaternionMsgFromYaw(snap.encTh*M_PI/180);
+
+  odom_base.translation.x = snap.encX/1000;
+  odom_base.translation.y = snap.encY/1000;
+  odom_base.translation.z = 0.0;
+  odom_base.rotation = q;
+
+  odom.pose.pose.position.x = snap.encX/1000;
+  odom.pose.pose.position.y = snap.encY/1000;
+  odom.pose.pose.position.z = 0.0;
+  odom.pose.pose.orientation = q;
+  odom.twist.twist.linear.x = snap.vel/1000;
+  odom.twist.twist.linear.y = snap.latVel/1000;
+  odom.twist.twist.angular.z = snap.rotVel*M_PI/180;
+}
+
+bool updateStateString(const char *s, std_msgs::String& msg)
+{
+  if(s[0] == '\0' || msg.data == s)
+    return false;
+  msg.data = s;
+  return true;
+}
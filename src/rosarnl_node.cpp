@@ -1,65 +1,99 @@
 #include "rosarnl/rosarnl_node.h"
+#include "rosarnl/ArTimeToROSTime.h"
+#include "rosarnl/StateMessages.h"
 
+#include <algorithm>
+#include <cstring>
+
+// Copy of @a parent (same namespace) whose callbacks go to @a queue
+static ros::NodeHandle queueNodeHandle(const ros::NodeHandle& parent, ros::CallbackQueue *queue)
+{
+  ros::NodeHandle h(parent);
+  h.setCallbackQueue(queue);
+  return h;
+}
 
 RosArnlNode::RosArnlNode(ros::NodeHandle nh, ArnlSystem& arnlsys)  :
+  n(nh),
   arnl(arnlsys),
-  myPublishCB(this, &RosArnlNode::publish),
-  actionServer(nh, "move_base", boost::bind(&RosArnlNode::execute_action_cb, this, _1), false),
-  arnl_goal_done(false),
+  motion_nh(queueNodeHandle(nh, &motion_queue)),
+  action_nh(queueNodeHandle(nh, &action_queue)),
+  admin_nh(queueNodeHandle(nh, &admin_queue)),
+  diagnostics_nh(queueNodeHandle(nh, &diagnostics_queue)),
+  config(diagnostics_nh),
+  covariance_worker(arnlsys.locTask, config, [this] { return pose_pub.getNumSubscribers() > 0; }),
+  mySnapshotCB(this, &RosArnlNode::captureSnapshot),
+  publish_thread_running(false),
+  myCmdVelCB(this, &RosArnlNode::cmdVelTask),
+  cmd_vel_applied_seq(0),
+  cmd_vel_driving(false),
+  actionServer(action_nh, "move_base", boost::bind(&RosArnlNode::execute_action_cb, this, _1), false),
   action_executing(false),
+  action_outcome(ActionOutcomeNone),
+  action_preempt_signalled(false),
+  action_goal_x(0),
+  action_goal_y(0),
   shutdown_requested(false)
 {
-  n = nh;
-  
-  // Figure out what frame_id's to use. if a tf_prefix param is specified,
-  // it will be added to the beginning of the frame_ids.
-  //
-  // e.g. rosrun ... _tf_prefix:=MyRobot (or equivalently using <param>s in
-  // roslaunch files)
-  // will result in the frame_ids being set to /MyRobot/map etc,
-  // rather than /map. This is useful for Multi Robot Systems.
-  // See ROS Wiki for further details.
-
-  tf_prefix = tf::getPrefixParam(n);
-  frame_id_map = tf::resolve(tf_prefix, "odom");
-  frame_id_base_link = tf::resolve(tf_prefix, "base_link");
-  frame_id_bumper = tf::resolve(tf_prefix, "bumpers_frame");
-  frame_id_sonar = tf::resolve(tf_prefix, "sonar_frame");
-
-  pose_msg.header.frame_id = "odom";
+  // Frame names and other parameters are read once by RosArnlConfigStore, see
+  // RosArnlConfig::load().
 
   motors_state_pub = n.advertise<std_msgs::Bool>("motors_state", 1, true);
   motors_state.data = false;
-  published_motors_state = false;
   
   dock_state_pub = n.advertise<std_msgs::String>("dock_state", 1, true);
-  dock_state.data = "";
-  published_dock_state = false;
+  // Intern dock state names so publishing a change never builds a string.
+  // Index 0 is used when there is no dock mode.
+  dock_state_msgs.resize(1);
+  if(arnl.modeDock)
+  {
+    for(int i = ArServerModeDock::UNDOCKED; i <= ArServerModeDock::DOCKED; ++i)
+    {
+      std_msgs::String name;
+      name.data = arnl.modeDock->toString((ArServerModeDock::State)i);
+      dock_state_msgs.push_back(name);
+    }
+  }
 
   pose_pub = n.advertise<geometry_msgs::PoseWithCovarianceStamped>("amcl_pose", 5, true);
-
-  enable_srv = n.advertiseService("enable_motors", &RosArnlNode::enable_motors_cb, this);
-  disable_srv = n.advertiseService("disable_motors", &RosArnlNode::disable_motors_cb, this);
-  wander_srv = n.advertiseService("wander", &RosArnlNode::wander_cb, this);
-  change_map_srv = n.advertiseService("change_map", &RosArnlNode::change_map_cb, this);
-  stop_srv = n.advertiseService("stop", &RosArnlNode::stop_cb, this);
-  dock_srv = n.advertiseService("dock", &RosArnlNode::dock_cb, this);
-  undock_srv = n.advertiseService("undock", &RosArnlNode::undock_cb, this);
-  get_plan_srv = n.advertiseService("get_plan", &RosArnlNode::get_plan_cb, this);
+  odom_pub = n.advertise<nav_msgs::Odometry>("odom", 10);
+  extrapolated_pose_pub = n.advertise<geometry_msgs::PoseStamped>("extrapolated_pose", 10);
+
+  enable_srv = admin_nh.advertiseService("enable_motors", &RosArnlNode::enable_motors_cb, this);
+  disable_srv = admin_nh.advertiseService("disable_motors", &RosArnlNode::disable_motors_cb, this);
+  wander_srv = admin_nh.advertiseService("wander", &RosArnlNode::wander_cb, this);
+  change_map_srv = admin_nh.advertiseService("change_map", &RosArnlNode::change_map_cb, this);
+  stop_srv = admin_nh.advertiseService("stop", &RosArnlNode::stop_cb, this);
+  dock_srv = admin_nh.advertiseService("dock", &RosArnlNode::dock_cb, this);
+  undock_srv = admin_nh.advertiseService("undock", &RosArnlNode::undock_cb, this);
+  get_plan_srv = admin_nh.advertiseService("get_plan", &RosArnlNode::get_plan_cb, this);
   
   // Only advertise the wheel light service if the robot is equipped with them
   std::string robot_type;
   n.param<std::string>("General_settings/Subclass", robot_type, "not_found");
   if (robot_type == "pioneer-lx") {
-    wheel_light_srv = n.advertiseService("wheel_lights", &RosArnlNode::wheel_light_cb, this);
+    wheel_light_srv = admin_nh.advertiseService("wheel_lights", &RosArnlNode::wheel_light_cb, this);
   }
 
-  global_localization_srv = n.advertiseService("global_localization", &RosArnlNode::global_localization_srv_cb, this);
+  global_localization_srv = admin_nh.advertiseService("global_localization", &RosArnlNode::global_localization_srv_cb, this);
+
+  get_poses_srv = motion_nh.advertiseService("get_poses", &RosArnlNode::get_poses_cb, this);
 
-  initialpose_sub = n.subscribe("initialpose", 1, (boost::function <void(const geometry_msgs::PoseStampedConstPtr&)>) boost::bind(&RosArnlNode::initialpose_sub_cb, this, _1));
+  initialpose_sub = motion_nh.subscribe("initialpose", 1, (boost::function <void(const geometry_msgs::PoseStampedConstPtr&)>) boost::bind(&RosArnlNode::initialpose_sub_cb, this, _1));
 
   arnl_server_mode_pub = n.advertise<std_msgs::String>("arnl_server_mode", -1);
   arnl_server_status_pub = n.advertise<std_msgs::String>("arnl_server_status", -1);
+  server_mode_msg.data.reserve(256);
+  server_status_msg.data.reserve(1024);
+
+  // map->odom published by publishTransform(), odom->base_link by
+  // publishOdometry()
+  tf_pub = n.advertise<tf2_msgs::TFMessage>("/tf", 100);
+  tf_msg.transforms.resize(1);
+  odom_tf_msg.transforms.resize(1);
+
+  // latency histograms, published by publishDiagnostics()
+  diagnostics_pub = n.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10);
 
   arnl_shutdown_confirm_pub = n.advertise<std_msgs::Empty>("arnl_shutdown_status", -1);
   
@@ -67,14 +101,14 @@ RosArnlNode::RosArnlNode(ros::NodeHandle nh, ArnlSystem& arnlsys)  :
   
   // Battery Publishing
   battery_pub = n.advertise<rosarnl::BatteryStatus>("battery_status", 1, true);
-  battery_pub_period = ros::Duration(5.0);
-
-  // TODO the move_base and move_bas_simple topics should be in separate node
-  // handles?
-  simple_goal_sub = n.subscribe("move_base_simple/goal", 1, (boost::function <void(const geometry_msgs::PoseStampedConstPtr&)>) boost::bind(&RosArnlNode::simple_goal_sub_cb, this, _1));
-  cmd_drive_sub = n.subscribe("cmd_vel", 1, (boost::function <void(const geometry_msgs::TwistConstPtr&)>) boost::bind(&RosArnlNode::cmdvel_cb, this, _1));
-  goalname_sub = n.subscribe("goalname", 1, (boost::function <void(const std_msgs::StringConstPtr&)>) boost::bind(&RosArnlNode::goalname_sub_cb, this, _1));
-  shutdown_sub = n.subscribe("/shutdown", 1, (boost::function <void(const std_msgs::EmptyConstPtr&)>) boost::bind(&RosArnlNode::shutdown_rosarnl_cb, this, _1));
+
+  // Subscriptions and services are split across callback queues (see
+  // Setup()) so that slow administrative services like global_localization
+  // or change_map never hold up cmd_vel, goals or initialpose.
+  simple_goal_sub = motion_nh.subscribe("move_base_simple/goal", 1, (boost::function <void(const geometry_msgs::PoseStampedConstPtr&)>) boost::bind(&RosArnlNode::simple_goal_sub_cb, this, _1));
+  cmd_drive_sub = motion_nh.subscribe("cmd_vel", 1, (boost::function <void(const geometry_msgs::TwistConstPtr&)>) boost::bind(&RosArnlNode::cmdvel_cb, this, _1));
+  goalname_sub = motion_nh.subscribe("goalname", 1, (boost::function <void(const std_msgs::StringConstPtr&)>) boost::bind(&RosArnlNode::goalname_sub_cb, this, _1));
+  shutdown_sub = diagnostics_nh.subscribe("/shutdown", 1, (boost::function <void(const std_msgs::EmptyConstPtr&)>) boost::bind(&RosArnlNode::shutdown_rosarnl_cb, this, _1));
   
   
   
@@ -88,15 +122,18 @@ RosArnlNode::RosArnlNode(ros::NodeHandle nh, ArnlSystem& arnlsys)  :
   arnl.pathTask->addStateChangeCB(new ArFunctorC<RosArnlNode>(this, &RosArnlNode::arnl_path_state_change_cb));
 
 
-  // Publish data triggered by ARIA sensor interpretation task
+  // Snapshot robot state from the ARIA sensor interpretation task. The
+  // messages are built and published by the publishing thread started in
+  // Setup().
   arnl.robot->lock();
-  arnl.robot->addSensorInterpTask("ROSPublishingTask", 100, &myPublishCB);
+  arnl.robot->addSensorInterpTask("ROSSnapshotTask", 100, &mySnapshotCB);
+  arnl.robot->addUserTask("ROSCmdVelTask", 50, &myCmdVelCB);
   arnl.robot->unlock();
 
   // Speech synthesis
   #ifdef ROSARNL_SPEECH
     if(cepstral.init()) {
-      speech_sub_ = n.subscribe("speak", 5, (boost::function <void(const std_msgs::StringConstPtr&)>) boost::bind(&RosArnlNode::speech_cb, this, _1));
+      speech_sub_ = admin_nh.subscribe("speak", 5, (boost::function <void(const std_msgs::StringConstPtr&)>) boost::bind(&RosArnlNode::speech_cb, this, _1));
     }
     else {
       ROS_ERROR("Error initializing speech synthesizer.");
@@ -106,198 +143,478 @@ RosArnlNode::RosArnlNode(ros::NodeHandle nh, ArnlSystem& arnlsys)  :
 
 RosArnlNode::~RosArnlNode()
 {
+  stopSpinners();
+
+  arnl.robot->lock();
+  arnl.robot->remSensorInterpTask(&mySnapshotCB);
+  arnl.robot->remUserTask(&myCmdVelCB);
+  arnl.robot->unlock();
+
+  publish_thread_running = false;
+  snapshot_cond.notify_all();
+  if(publish_thread.joinable())
+    publish_thread.join();
+  covariance_worker.stop();
+
   Aria::exit(0);
 }
 
 bool RosArnlNode::Setup()
 {
+  actionServer.registerPreemptCallback(boost::bind(&RosArnlNode::action_preempt_cb, this));
+
+  const RosArnlConfig& cfg = config.get();
+  motion_spinner.reset(new ros::AsyncSpinner(cfg.motion_threads, &motion_queue));
+  action_spinner.reset(new ros::AsyncSpinner(cfg.action_threads, &action_queue));
+  admin_spinner.reset(new ros::AsyncSpinner(cfg.admin_threads, &admin_queue));
+  diagnostics_spinner.reset(new ros::AsyncSpinner(cfg.diagnostics_threads, &diagnostics_queue));
+  motion_spinner->start();
+  action_spinner->start();
+  admin_spinner->start();
+  diagnostics_spinner->start();
+
   actionServer.start();
+  covariance_worker.start();
+  setupPublishScheduler(config.get());
+  publish_thread_running = true;
+  publish_thread = std::thread(&RosArnlNode::publishThreadMain, this);
   return true;
 }
 
 void RosArnlNode::spin()
 {
   ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: Running ROS node...");
-  ros::Rate loopRate(10.0);
-  while (!shutdown_requested)
-  {
-    ros::spinOnce();
-    publish();
-    loopRate.sleep();
-  }
+
+  // All of our own callbacks are on the queues served by the spinners started
+  // in Setup(); this one serves anything left on the global queue.
+  ros::AsyncSpinner global_spinner(1);
+  global_spinner.start();
+
+  // Nothing to do here but wait to be told to shut down, either by a message
+  // on /shutdown or by roscpp (e.g. SIGINT). roscpp has no wakeup for the
+  // latter, so also check ros::ok() periodically.
+  std::unique_lock<std::mutex> lock(shutdown_mutex);
+  while (!shutdown_requested && ros::ok())
+    shutdown_cond.wait_for(lock, std::chrono::milliseconds(500));
+  lock.unlock();
+
+  global_spinner.stop();
   ROS_INFO("Shutdown request for rosarnl_node");
 }
 
+void RosArnlNode::stopSpinners()
+{
+  if(motion_spinner) motion_spinner->stop();
+  if(action_spinner) action_spinner->stop();
+  if(admin_spinner) admin_spinner->stop();
+  if(diagnostics_spinner) diagnostics_spinner->stop();
+}
+
+// Localized pose and velocities of @a snap in ROS units. Only arithmetic, so
+// safe to call from the robot cycle.
+static PoseSample poseSampleFromSnapshot(const RobotStateSnapshot& snap)
+{
+  PoseSample s;
+  s.t = convertArTimeToROS(snap.packetTime).toSec();
+  s.x = snap.x/1000;
+  s.y = snap.y/1000;
+  s.th = snap.th*M_PI/180;
+  s.vx = snap.vel/1000;
+  s.vy = snap.latVel/1000;
+  s.wz = snap.rotVel*M_PI/180;
+  return s;
+}
+
+// Copy @a s (may be NULL) into a fixed size snapshot field, truncating.
+static void copyStateString(char *dest, size_t size, const char *s)
+{
+  if(s == NULL)
+    s = "";
+  strncpy(dest, s, size - 1);
+  dest[size - 1] = '\0';
+}
+
+void RosArnlNode::captureSnapshot()
+{
+  // Note, this is called via SensorInterpTask callback (mySnapshotCB, named
+  // "ROSSnapshotTask"). ArRobot object 'robot' is already locked and should
+  // not be locked or unlocked here.  Only copy state; anything slower belongs
+  // in the publishing thread.
+  // Every field is filled in, so the buffer's old contents don't matter.
+  RobotStateSnapshot& snap = snapshot_buffer.back();
+  snap.time.setToNow();
+  snap.packetTime = arnl.robot->getLastPacketTime();
+  const ArPose pos = arnl.robot->getPose();
+  snap.x = pos.getX();
+  snap.y = pos.getY();
+  snap.th = pos.getTh();
+  const ArPose enc = arnl.robot->getEncoderPose();
+  snap.encX = enc.getX();
+  snap.encY = enc.getY();
+  snap.encTh = enc.getTh();
+  snap.vel = arnl.robot->getVel();
+  snap.rotVel = arnl.robot->getRotVel();
+  snap.latVel = arnl.robot->getLatVel();
+  snap.motorsEnabled = arnl.robot->areMotorsEnabled();
+  snap.estop = arnl.robot->isEStopPressed();
+  snap.stateOfCharge = arnl.robot->getStateOfCharge();
+  snap.chargeState = arnl.robot->getChargeState();
+  snap.dockState = arnl.modeDock ? (int)arnl.modeDock->getState() : -1;
+  snap.pathState = (int)arnl.pathTask->getState();
+  // The active server mode updates these from robot tasks, so they can only
+  // be read here, under the robot lock.
+  copyStateString(snap.serverStatus, sizeof(snap.serverStatus), arnl.getServerStatus());
+  copyStateString(snap.serverMode, sizeof(snap.serverMode), arnl.getServerMode());
+
+  // Written here rather than by the publishing thread so the history has
+  // every cycle even if that thread falls behind.
+  pose_extrapolator.addSample(poseSampleFromSnapshot(snap));
+
+  // Wakes anything waiting on a motors, e-stop, dock or charge state change.
+  state_notifier.update(snap);
+
+  // If the publishing thread has fallen behind, this replaces the snapshot
+  // it has not taken yet, so when it catches up it publishes the current
+  // state (odometry from the cycles in between is not published).
+  snapshot_buffer.publish();
+  snapshot_cond.notify_one();
+}
+
+void RosArnlNode::setupPublishScheduler(const RosArnlConfig& cfg)
+{
+  stream_pose = scheduler.addStream("amcl_pose", cfg.pose_rate, boost::bind(&RosArnlNode::publishPose, this));
+  stream_tf = scheduler.addStream("tf", cfg.tf_rate, boost::bind(&RosArnlNode::publishTransform, this));
+  stream_feedback = scheduler.addStream("move_base/feedback", cfg.feedback_rate, boost::bind(&RosArnlNode::publishFeedback, this));
+  stream_battery = scheduler.addStream("battery_status", 1.0 / cfg.battery_period, boost::bind(&RosArnlNode::publishBattery, this));
+  stream_state = scheduler.addStream("state", cfg.state_rate, boost::bind(&RosArnlNode::publishStateTopics, this));
+  stream_extrapolated_pose = scheduler.addStream("extrapolated_pose", cfg.extrapolated_pose_rate, boost::bind(&RosArnlNode::publishExtrapolatedPose, this));
+  stream_diagnostics = scheduler.addStream("diagnostics", cfg.diagnostics_rate, boost::bind(&RosArnlNode::publishDiagnostics, this));
+  stream_clock_sync = scheduler.addStream("clock mapping", cfg.clock_sync_rate, boost::bind(&RosArnlNode::updateClockMapping, this));
+  config.addChangeCB(boost::bind(&RosArnlNode::updatePublishRates, this, _1));
+}
+
+void RosArnlNode::updatePublishRates(const RosArnlConfig& cfg)
+{
+  scheduler.setRate(stream_pose, cfg.pose_rate);
+  scheduler.setRate(stream_tf, cfg.tf_rate);
+  scheduler.setRate(stream_feedback, cfg.feedback_rate);
+  scheduler.setRate(stream_battery, 1.0 / cfg.battery_period);
+  scheduler.setRate(stream_state, cfg.state_rate);
+  scheduler.setRate(stream_extrapolated_pose, cfg.extrapolated_pose_rate);
+  scheduler.setRate(stream_diagnostics, cfg.diagnostics_rate);
+  scheduler.setRate(stream_clock_sync, cfg.clock_sync_rate);
+}
+
+void RosArnlNode::publishThreadMain()
+{
+  bool have_snapshot = false;
+  PublishScheduler::Clock::time_point next_deadline = PublishScheduler::Clock::now();
+  while(publish_thread_running)
+  {
+    {
+      // Wake for the next scheduled emission, or for a new snapshot so every
+      // robot cycle's odometry goes out. The producer notifies without taking
+      // the mutex so that the robot cycle never blocks on this thread; a
+      // wakeup lost in that window only delays it until the next deadline.
+      std::unique_lock<std::mutex> lock(snapshot_mutex);
+      snapshot_cond.wait_until(lock, next_deadline, [this] {
+        return snapshot_buffer.fresh() || !publish_thread_running;
+      });
+    }
+    bool new_snapshot = false;
+    if(snapshot_buffer.take())
+    {
+      latest_snapshot = snapshot_buffer.front();
+      have_snapshot = new_snapshot = true;
+    }
+
+    // Publish motors, dock and charge state changes right away rather than
+    // waiting for the next state_rate period.
+    const unsigned int changes = state_notifier.takeChanges();
+    if(changes != 0)
+      publishStateChanges(changes);
+
+    // Nothing to publish until the robot has completed a cycle.
+    if(!have_snapshot)
+    {
+      next_deadline = PublishScheduler::Clock::now() + std::chrono::milliseconds(100);
+      continue;
+    }
 
+    LatencyScope timer(publish_latency);
+    // Odometry goes out once per robot cycle, not on a schedule, so that
+    // controllers get every SIP.
+    if(new_snapshot)
+      publishOdometry();
+    next_deadline = scheduler.runDue(PublishScheduler::Clock::now());
+  }
+}
 
-void RosArnlNode::publish()
+void RosArnlNode::publishPose()
 {
-  const ros::Time current_time = ros::Time::now();
+  const RobotStateSnapshot& snap = latest_snapshot;
+  const RosArnlConfig& cfg = config.get();
+
+  pose_alloc_check.begin();
   
   // todo could only publish if robot not stopped (unless arnl has TriggerTime
   // set in which case it might update localization even ifnot moving), or
   // use a callback from arnl for robot pose updates rather than every aria
-  // cycle.  In particular, getting the covariance is a bit computational
-  // intensive and not everyone needs it.
+  // cycle.
 
-  ArTime tasktime;
+  fillPose(snap, pose_msg.pose.pose);
 
-  // Note, this is called via SensorInterpTask callback (myPublishCB, named "ROSPublishingTask"). ArRobot object 'robot' sholud not be locked or unlocked.
-  const ArPose pos = arnl.robot->getPose();
+  // ArRobot's pose is ARNL's last localization carried forward by odometry,
+  // so it is the robot pose as of the SIP it was last updated from. Stamp it
+  // with that packet's receive time, mapped onto ROS time. While the robot is
+  // stopped ARNL may not re-localize; the time since it last did is reported
+  // on /diagnostics.
+  pose_msg.header.stamp = convertArTimeToROS(snap.packetTime);
+  pose_msg.header.frame_id = cfg.frame_id_map;
 
-  // convert mm and degrees to position meters and quaternion angle in ros pose
-  tf::poseTFToMsg(tf::Transform(tf::createQuaternionFromYaw(pos.getTh()*M_PI/180), tf::Vector3(pos.getX()/1000,
-    pos.getY()/1000, 0)), pose_msg.pose.pose);
+  fillCovariance(pose_msg.pose);
 
-  // ARIA/ARNL times are in reference to an arbitrary starting time, not OS
-  // clock, so find the time elapsed between now and last ARNL localization
-  // to adjust the time stamp in ROS time vs. now accordingly.
-  pose_msg.header.stamp = current_time;
+  pose_alloc_check.end();
 
-  // TODO if robot is stopped, ARNL won't re-localize (unless TriggerTime option is
-  // configured), so should we just use Time::now() in that case? or do usoseers
-  // expect long ages for poses if robot stopped?
-  
-  bool use_covariance;
-  n.getParam("/rosarnl_node/use_covariance", use_covariance);
+  pose_pub.publish(pose_msg);
+}
 
-  if (use_covariance) {
-    ArMatrix var;
-    ArPose meanp;
-    if(arnl.locTask->findLocalizationMeanVar(meanp, var))
-    {
-      /*
-      ROS pose covariance is 6x6 with position and orientation in 3
-      dimensions each x, y, z, roll, pitch, yaw (but placed all in one 1-d
-      boost::array container;
-      
-      ARNL has x, y, yaw (aka theta):
+void RosArnlNode::fillCovariance(geometry_msgs::PoseWithCovariance& pose)
+{
+  // The covariance is computed by covariance_worker in its own thread; only
+  // attach the most recent result here.
+  double var[9];
+  ArTime var_loc_time;
+  if (config.get().use_covariance && covariance_worker.getLatest(var, var_loc_time)) {
+    /*
+    ROS pose covariance is 6x6 with position and orientation in 3
+    dimensions each x, y, z, roll, pitch, yaw (but placed all in one 1-d
+    boost::array container;
+    
+    ARNL has x, y, yaw (aka theta), stored row major in var:
 	x*x   x*y   x*yaw
 	y*x   y*y   y*yaw
 	yaw*x yaw*y yaw*yaw
-      
-      Also convert mm to m and degrees to radians.
-      
-      all elements in pose_msg.pose.covariance were initialized to -1 (invalid
-      marker) in the RosArnlNode constructor, so just update elements that
-      contain x, y and yaw.
-      */
     
-      pose_msg.pose.covariance[/*6*0 + 0*/ 0] = var(0,0)/1000.0;  // x/x
-      pose_msg.pose.covariance[/*6*0 + 1*/ 1] = var(0,1)/1000.0;  // x/y
-      pose_msg.pose.covariance[/*6*0 + 5*/ 5] = ArMath::degToRad(var(0,2)/1000.0);    //x/yaw
-      pose_msg.pose.covariance[/*6*1 + 0*/ 6] = var(1,0)/1000.0;  //y/x
-      pose_msg.pose.covariance[/*6*1 + 1*/ 7] = var(1,1)/1000.0;  // y/y
-      pose_msg.pose.covariance[/*6*1 + 5*/ 11] = ArMath::degToRad(var(1,2)/1000.0);  // y/yaw
-      pose_msg.pose.covariance[/*6*5 + 0*/ 30] = ArMath::degToRad(var(2,0)/1000.0);  //yaw/x
-      pose_msg.pose.covariance[/*6*5 + 1*/ 31] = ArMath::degToRad(var(2,1)/1000.0);  // yaw*y
-      pose_msg.pose.covariance[/*6*5 + 5*/ 35] = ArMath::degToRad(var(2,2)); // yaw*yaw
-    }
-  }
+    Also convert mm to m and degrees to radians.
+    
+    Only update elements that contain x, y and yaw.
+    */
   
-  pose_pub.publish(pose_msg);
-
-  // Battery info publishing
-  // Check for periodic timeout
-  if (current_time - last_battery_pub_time > battery_pub_period)
+    pose.covariance[/*6*0 + 0*/ 0] = var[0]/1000.0;  // x/x
+    pose.covariance[/*6*0 + 1*/ 1] = var[1]/1000.0;  // x/y
+    pose.covariance[/*6*0 + 5*/ 5] = ArMath::degToRad(var[2]/1000.0);    //x/yaw
+    pose.covariance[/*6*1 + 0*/ 6] = var[3]/1000.0;  //y/x
+    pose.covariance[/*6*1 + 1*/ 7] = var[4]/1000.0;  // y/y
+    pose.covariance[/*6*1 + 5*/ 11] = ArMath::degToRad(var[5]/1000.0);  // y/yaw
+    pose.covariance[/*6*5 + 0*/ 30] = ArMath::degToRad(var[6]/1000.0);  //yaw/x
+    pose.covariance[/*6*5 + 1*/ 31] = ArMath::degToRad(var[7]/1000.0);  // yaw*y
+    pose.covariance[/*6*5 + 5*/ 35] = ArMath::degToRad(var[8]); // yaw*yaw
+  }
+  else
   {
-    rosarnl::BatteryStatus battery_msg;
-    battery_msg.charge_percent = arnl.robot->getStateOfCharge();
-    battery_msg.charging_state = arnl.robot->getChargeState();
-    battery_pub.publish(battery_msg);
-    last_battery_pub_time = current_time;
+    // The message is reused, so clear any covariance from when the feature
+    // was on rather than publish it forever.
+    std::fill(pose.covariance.begin(), pose.covariance.end(), 0.0);
   }
+}
+
+void RosArnlNode::publishBattery()
+{
+  battery_msg.charge_percent = latest_snapshot.stateOfCharge;
+  battery_msg.charging_state = latest_snapshot.chargeState;
+  battery_pub.publish(battery_msg);
+}
 
+void RosArnlNode::publishFeedback()
+{
   if(action_executing) 
   {
-    move_base_msgs::MoveBaseFeedback feedback;
-    feedback.base_position.pose = pose_msg.pose.pose;
-    actionServer.publishFeedback(feedback);
+    feedback_alloc_check.begin();
+    feedback_msg.base_position.header.stamp = convertArTimeToROS(latest_snapshot.packetTime);
+    feedback_msg.base_position.header.frame_id = config.get().frame_id_map;
+    fillPose(latest_snapshot, feedback_msg.base_position.pose);
+    feedback_alloc_check.end();
+    actionServer.publishFeedback(feedback_msg);
   }
+}
 
+void RosArnlNode::publishTransform()
+{
+  const RobotStateSnapshot& snap = latest_snapshot;
+  const RosArnlConfig& cfg = config.get();
+
+  tf_alloc_check.begin();
+
+  // publishing transform map->odom: the correction from the raw encoder
+  // pose to ARNL's localized pose, both taken in the same robot cycle.
+  // tf_msg always holds exactly this one transform, so it is reused instead
+  // of going through tf2_ros::TransformBroadcaster, which builds a new
+  // vector every call.
+  // odom->base_link goes out every robot cycle but this only at tf_rate, so
+  // like amcl it is post-dated by transform_tolerance: lookups of map->
+  // base_link at the newest odometry stamp then succeed between updates.
+  geometry_msgs::TransformStamped& map_trans = tf_msg.transforms[0];
+  map_trans.header.stamp = convertArTimeToROS(snap.packetTime) + ros::Duration(cfg.transform_tolerance);
+  map_trans.header.frame_id = cfg.frame_id_map;
+  map_trans.child_frame_id = cfg.frame_id_odom;
+  fillMapToOdom(snap, map_trans.transform);
+
+  tf_alloc_check.end();
+
+  tf_pub.publish(tf_msg);
+}
 
-  // publishing transform map->base_link
-  map_trans.header.stamp.sec = current_time.toSec();
-  map_trans.header.stamp.nsec = current_time.toNSec();
-  map_trans.header.frame_id = frame_id_map;
-  map_trans.child_frame_id = frame_id_base_link;
-  
-  map_trans.transform.translation.x = pos.getX()/1000;
-  map_trans.transform.translation.y = pos.getY()/1000;
-  map_trans.transform.translation.z = 0.0;
-  map_trans.transform.rotation = tf::createQuaternionMsgFromYaw(pos.getTh()*M_PI/180);
+void RosArnlNode::publishOdometry()
+{
+  const RobotStateSnapshot& snap = latest_snapshot;
+  const RosArnlConfig& cfg = config.get();
 
-  map_broadcaster.sendTransform(map_trans);
+  odom_alloc_check.begin();
 
-  
-  // publish motors state if changed
-  bool e = arnl.robot->areMotorsEnabled();
-  if(e != motors_state.data || !published_motors_state)
+  const ros::Time stamp = convertArTimeToROS(snap.packetTime);
+
+  // odom->base_link, and the same pose in the odom frame with velocities in
+  // the robot (base_link) frame
+  geometry_msgs::TransformStamped& odom_trans = odom_tf_msg.transforms[0];
+  odom_trans.header.stamp = stamp;
+  odom_trans.header.frame_id = cfg.frame_id_odom;
+  odom_trans.child_frame_id = cfg.frame_id_base_link;
+  odom_msg.header.stamp = stamp;
+  odom_msg.header.frame_id = cfg.frame_id_odom;
+  odom_msg.child_frame_id = cfg.frame_id_base_link;
+  fillOdometry(snap, odom_trans.transform, odom_msg);
+
+  odom_alloc_check.end();
+
+  tf_pub.publish(odom_tf_msg);
+  odom_pub.publish(odom_msg);
+}
+
+bool RosArnlNode::get_poses_cb(rosarnl::GetPoses::Request& request, rosarnl::GetPoses::Response& response)
+{
+  const RosArnlConfig& cfg = config.get();
+  response.poses.resize(request.stamps.size());
+  response.valid.resize(request.stamps.size());
+  for(size_t i = 0; i < request.stamps.size(); ++i)
   {
-    ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: New motor state: %s.", e?"yes":"no");
-    motors_state.data = e;
-    motors_state_pub.publish(motors_state);
-    published_motors_state = true;
+    geometry_msgs::PoseStamped& pose = response.poses[i];
+    pose.header.stamp = request.stamps[i];
+    pose.header.frame_id = cfg.frame_id_map;
+    PoseSample p;
+    response.valid[i] = pose_extrapolator.poseAt(request.stamps[i].toSec(), cfg.pose_extrapolation_limit, p);
+    if(!response.valid[i])
+    {
+      pose.pose.orientation.w = 1.0;
+      continue;
+    }
+    pose.pose.position.x = p.x;
+    pose.pose.position.y = p.y;
+    pose.pose.orientation = tf::createQuaternionMsgFromYaw(p.th);
   }
-  
-  // publish dock state if changed
-  std::string state(arnl.modeDock->toString(arnl.modeDock->getState()));
-  if(state != dock_state.data)
+  return true;
+}
+
+void RosArnlNode::publishExtrapolatedPose()
+{
+  const RosArnlConfig& cfg = config.get();
+  const ros::Time now = ros::Time::now();
+  PoseSample p;
+  if(!pose_extrapolator.poseAt(now.toSec(), cfg.pose_extrapolation_limit, p))
+    return;  // no robot cycle recently enough
+
+  extrapolated_pose_alloc_check.begin();
+  extrapolated_pose_msg.header.stamp = now;
+  extrapolated_pose_msg.header.frame_id = cfg.frame_id_map;
+  extrapolated_pose_msg.pose.position.x = p.x;
+  extrapolated_pose_msg.pose.position.y = p.y;
+  extrapolated_pose_msg.pose.position.z = 0.0;
+  extrapolated_pose_msg.pose.orientation = tf::createQuaternionMsgFromYaw(p.th);
+  extrapolated_pose_alloc_check.end();
+
+  extrapolated_pose_pub.publish(extrapolated_pose_msg);
+}
+
+void RosArnlNode::publishStateChanges(unsigned int changes)
+{
+  const RobotStateSnapshot state = state_notifier.getState();
+
+  if(changes & RobotStateNotifier::MotorsChanged)
   {
-    ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: New dock state: %s.", e?"yes":"no");
-    dock_state.data = state;
-    dock_state_pub.publish(dock_state);
-    published_dock_state = true;
+    ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: New motor state: %s.", state.motorsEnabled?"yes":"no");
+    motors_state.data = state.motorsEnabled;
+    motors_state_pub.publish(motors_state);
   }
 
-  const char *s = arnl.getServerStatus();
-  if(s != NULL && lastServerStatus != s)
+  if(changes & RobotStateNotifier::EStopChanged)
+    ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: E-stop %s.", state.estop?"pressed":"released");
+
+  // Dock state names are interned in dock_state_msgs at startup (index 0 is
+  // "no dock mode", which is never published).
+  if(changes & RobotStateNotifier::DockStateChanged)
   {
-    ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: New server status: %s", s);
-    lastServerStatus = s;
-    std_msgs::String msg;
-    msg.data = lastServerStatus;
-    arnl_server_status_pub.publish(msg);
+    size_t dock_index = (size_t)(state.dockState + 1);
+    if(dock_index >= dock_state_msgs.size())
+      dock_index = 0;
+    if(dock_index != 0)
+    {
+      ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: New dock state: %s.", dock_state_msgs[dock_index].data.c_str());
+      dock_state_pub.publish(dock_state_msgs[dock_index]);
+    }
   }
 
-  const char *m = arnl.getServerMode();
-  if(m != NULL && lastServerMode != m)
+  // Send battery status now rather than up to battery_period later when
+  // charging starts or stops.
+  if(changes & RobotStateNotifier::ChargeStateChanged)
   {
-    ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: New server mode: %s", m);
-    lastServerMode = m;
-    std_msgs::String msg;
-    msg.data = lastServerMode;
-    arnl_server_mode_pub.publish(msg);
+    battery_msg.charge_percent = state.stateOfCharge;
+    battery_msg.charging_state = state.chargeState;
+    battery_pub.publish(battery_msg);
   }
+}
+
+void RosArnlNode::publishStateTopics()
+{
+  state_alloc_check.begin();
+
+  // The status and mode strings were copied into the snapshot by
+  // captureSnapshot(). The message strings have capacity reserved at
+  // startup, so assigning normally does not allocate.
+  const bool new_status = updateStateString(latest_snapshot.serverStatus, server_status_msg);
+  const bool new_mode = updateStateString(latest_snapshot.serverMode, server_mode_msg);
+
+  state_alloc_check.end();
 
+  if(new_status)
+  {
+    ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: New server status: %s", server_status_msg.data.c_str());
+    arnl_server_status_pub.publish(server_status_msg);
+  }
 
-  ROS_WARN_COND_NAMED((tasktime.mSecSince() > 20), "rosarnl_node", "rosarnl_node: publish aria task took %ld ms", tasktime.mSecSince());
+  if(new_mode)
+  {
+    ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: New server mode: %s", server_mode_msg.data.c_str());
+    arnl_server_mode_pub.publish(server_mode_msg);
+  }
 }
 
 bool RosArnlNode::enable_motors_cb(std_srvs::Empty::Request& request, std_srvs::Empty::Response& response)
 {
     ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: Enable motors request.");
-    arnl.robot->lock();
     
     // Check if estop button is pressed.
     if (check_estop("enable motors")) {
       return false;
     }
     
+    arnl.robot->lock();
     arnl.robot->enableMotors();
     arnl.robot->unlock();
     
-    // Wait to see if it was successful.
-    ros::Time wait_start_time = ros::Time::now();
-    ros::Duration timeout_duration(1.0);
-    while (!arnl.robot->areMotorsEnabled()) {
-      // Check for timeout
-      if (ros::Time::now() - wait_start_time > timeout_duration) {
-  return false;
-      }
-    }
-    
-    return true;
+    // Wait to see if it was successful. Give up early if the e-stop is
+    // pressed meanwhile.
+    state_notifier.waitFor([](const RobotStateSnapshot& s) { return s.motorsEnabled || s.estop; }, 1.0);
+    return state_notifier.getState().motorsEnabled;
 }
 
 bool RosArnlNode::disable_motors_cb(std_srvs::Empty::Request& request, std_srvs::Empty::Response& response)
@@ -308,16 +625,7 @@ bool RosArnlNode::disable_motors_cb(std_srvs::Empty::Request& request, std_srvs:
     arnl.robot->unlock();
     
     // Wait to see if it was successful.
-    ros::Time wait_start_time = ros::Time::now();
-    ros::Duration timeout_duration(1.0);
-    while (arnl.robot->areMotorsEnabled()) {
-      // Check for timeout
-      if (ros::Time::now() - wait_start_time > timeout_duration) {
-  return false;
-      }
-    }
-    
-    return true;
+    return state_notifier.waitFor([](const RobotStateSnapshot& s) { return !s.motorsEnabled; }, 1.0);
 }
 
 bool RosArnlNode::wander_cb(std_srvs::Empty::Request& request, std_srvs::Empty::Response& response)
@@ -348,7 +656,18 @@ bool RosArnlNode::stop_cb(rosarnl::Stop::Request& request, rosarnl::Stop::Respon
 {
     ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: Stop request.");
     arnl.modeStop->activate();
-    response.stop_pose = pose_msg;
+    // pose_msg belongs to the publishing thread; take the pose from the
+    // lock-free pose history instead.
+    PoseSample p;
+    if(pose_extrapolator.getHistory().latest(p))
+    {
+      response.stop_pose.header.stamp = ros::Time(p.t);
+      response.stop_pose.header.frame_id = config.get().frame_id_map;
+      response.stop_pose.pose.pose.position.x = p.x;
+      response.stop_pose.pose.pose.position.y = p.y;
+      response.stop_pose.pose.pose.orientation = tf::createQuaternionMsgFromYaw(p.th);
+      fillCovariance(response.stop_pose.pose);
+    }
     return true;
 }
 
@@ -405,13 +724,26 @@ bool RosArnlNode::wheel_light_cb(rosarnl::WheelLight::Request& request, rosarnl:
 
 bool RosArnlNode::get_plan_cb(nav_msgs::GetPlan::Request& request, nav_msgs::GetPlan::Response& response)
 {
+  LatencyScope timer(get_plan_latency);
   // Transform to odom frame
   geometry_msgs::PoseStamped transformed_goal;
-  listener.transformPose(frame_id_map, request.goal, transformed_goal);
+  // A copy: planning can take longer than a config is kept after a reload.
+  const std::string frame_id_map = config.get().frame_id_map;
+  tf_buffer.transform(request.goal, transformed_goal, frame_id_map);
   
   const ArPose ar_goal = rosPoseToArPose(transformed_goal);
-  
-  const std::list<ArPose> ar_path = arnl.pathTask->getPathFromTo(arnl.robot->getPose(), ar_goal);
+
+  // Start from the latest robot pose. ArRobot::getPose() would need the
+  // robot lock; the pose history has it without locking.
+  PoseSample start;
+  if(!pose_extrapolator.getHistory().latest(start))
+  {
+    ROS_WARN_NAMED("rosarnl_node", "rosarnl_node: get_plan: no robot pose yet.");
+    return false;
+  }
+  const ArPose ar_start(start.x * 1000.0, start.y * 1000.0, ArMath::radToDeg(start.th));
+
+  const std::list<ArPose> ar_path = arnl.pathTask->getPathFromTo(ar_start, ar_goal);
   
   ROS_INFO_STREAM("ar_path size " << ar_path.size());
   
@@ -510,6 +842,40 @@ void RosArnlNode::arnl_new_goal_cb(ArPose arpose)
 }
 
 
+bool RosArnlNode::start_action_goal(const geometry_msgs::PoseStamped& target)
+{
+  // Transform to odom frame
+  geometry_msgs::PoseStamped transformed_goal;
+  try {
+    tf_buffer.transform(target, transformed_goal, config.get().frame_id_map);
+  }
+  catch(tf2::TransformException& e) {
+    ROS_ERROR_NAMED("rosarnl_node", "rosarnl_node: action: cannot transform goal to %s frame: %s", config.get().frame_id_map.c_str(), e.what());
+    return false;
+  }
+
+  const ArPose goalpose = rosPoseToArPose(transformed_goal);
+  ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: action: planning to goal %.0fmm, %.0fmm, %.0fdeg", goalpose.getX(), goalpose.getY(), goalpose.getTh());
+
+  // Record which goal we requested before requesting it, so that ARNL
+  // callbacks for a previous goal (e.g. the interrupt for the goal this one
+  // replaces) can be told apart from callbacks for this one. Mark the action
+  // as executing first too, or a goal done or failed callback that ARNL
+  // makes before gotoPose() returns would be dropped.
+  {
+    std::lock_guard<std::mutex> lock(action_mutex);
+    action_goal_x = goalpose.getX();
+    action_goal_y = goalpose.getY();
+    action_outcome = ActionOutcomeNone;
+    action_executing = true;
+  }
+
+  const bool heading = !ArMath::isNan(goalpose.getTh());
+  //arnl.pathTask->pathPlanToPose(goalpose, heading);
+  arnl.modeGoto->gotoPose(goalpose, heading);
+  return true;
+}
+
 void RosArnlNode::execute_action_cb(const move_base_msgs::MoveBaseGoalConstPtr &goal)
 {
   // the action execute callback is initiated by the first goal sent.  it should
@@ -519,34 +885,58 @@ void RosArnlNode::execute_action_cb(const move_base_msgs::MoveBaseGoalConstPtr &
   // reaching the goal, failure, or recognizing that the goal has been
   // preempted, which allows it to work in combination with MobileEyes or other
   // clients as well as the ros action client.
+  //
+  // The arnl callbacks (path planning thread) and the actionlib preempt
+  // callback only record what happened and signal action_cond; all calls that
+  // change the action server's state are made from this thread.
   ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: action: begin execution for new goal.");
-  
-  // Transform to odom frame
-  geometry_msgs::PoseStamped transformed_goal;
-  ROS_INFO_STREAM(goal->target_pose);
-  ROS_INFO_STREAM(frame_id_map);
-  listener.transformPose(frame_id_map, goal->target_pose, transformed_goal);
 
-  
-  action_executing  = true;
-  ArPose goalpose = rosPoseToArPose(transformed_goal);
-  ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: action: planning to goal %.0fmm, %.0fmm, %.0fdeg", goalpose.getX(), goalpose.getY(), goalpose.getTh());
-  
-  bool heading = !ArMath::isNan(goalpose.getTh());
-  //arnl.pathTask->pathPlanToPose(goalpose, heading);
-  arnl.modeGoto->gotoPose(goalpose, heading);
-  arnl_goal_done = false;
-  
-  ros::Rate loopRate(20.0);
+  {
+    std::lock_guard<std::mutex> lock(action_mutex);
+    action_preempt_signalled = false;
+  }
+  if(!start_action_goal(goal->target_pose))
+  {
+    action_executing = false;
+    actionServer.setAborted(move_base_msgs::MoveBaseResult(), "Could not transform goal to map frame");
+    return;
+  }
+
   while(n.ok() && actionServer.isActive())
   {
     // TODO check for localization lost
 
-    if(arnl_goal_done)
+    int outcome;
     {
-      ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: action: goal done, ending execution.");
-      action_executing = false;
-      return;
+      // The timeout only serves to notice node shutdown.
+      std::unique_lock<std::mutex> lock(action_mutex);
+      action_cond.wait_for(lock, std::chrono::milliseconds(500), [this] {
+        return action_outcome != ActionOutcomeNone || action_preempt_signalled || !n.ok();
+      });
+      outcome = action_outcome;
+      action_outcome = ActionOutcomeNone;
+      action_preempt_signalled = false;
+    }
+    LatencyScope timer(action_loop_latency);
+
+    switch(outcome)
+    {
+      case ActionOutcomeSucceeded:
+        ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: action: goal succeeded, ending execution.");
+        action_executing = false;
+        actionServer.setSucceeded(move_base_msgs::MoveBaseResult(), "Goal succeeded");
+        return;
+      case ActionOutcomeFailed:
+        ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: action: goal failed, ending execution.");
+        action_executing = false;
+        actionServer.setAborted(move_base_msgs::MoveBaseResult(), "Goal failed");
+        return;
+      case ActionOutcomeInterrupted:
+        // Someone else (e.g. MobileEyes) gave ARNL a different goal.
+        ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: action: goal interrupted, ending execution.");
+        action_executing = false;
+        actionServer.setPreempted();
+        return;
     }
 
     if(actionServer.isPreemptRequested())
@@ -555,92 +945,201 @@ void RosArnlNode::execute_action_cb(const move_base_msgs::MoveBaseGoalConstPtr &
       {
         // we were preempted by a new goal
         move_base_msgs::MoveBaseGoalConstPtr newgoal = actionServer.acceptNewGoal();
-  
-        // Transform to odom frame
-        listener.transformPose(frame_id_map, newgoal->target_pose, transformed_goal);
-  
-        goalpose = rosPoseToArPose(transformed_goal);
-        ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: action: new goal interrupted current goal.  planning to new goal %.0fmm, %.0fmm, %.0fdeg", goalpose.getX(), goalpose.getY(), goalpose.getTh());
-        bool heading = !ArMath::isNan(goalpose.getTh());
-        arnl.modeGoto->gotoPose(goalpose, heading);
-      
-        // action server will be set to preempted state by arnl interrupt
-        // callback.
+        ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: action: new goal interrupted current goal.");
+        if(!start_action_goal(newgoal->target_pose))
+        {
+          action_executing = false;
+          actionServer.setAborted(move_base_msgs::MoveBaseResult(), "Could not transform goal to map frame");
+          arnl.modeGoto->deactivate();
+          return;
+        }
+        // ARNL's interrupt callback for the previous goal is ignored since it
+        // no longer matches the requested goal.
       }
       else
       {
         // we were simply asked to just go to "preempted" end state, with no new
         // goal
         ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: action: forced to preempted, ending execution.");
-        actionServer.setPreempted();
         action_executing = false;
+        actionServer.setPreempted();
         arnl.modeGoto->deactivate();
         
         return;
       }
     }
 
-    // feedback is published in the publish() task callback 
-    loopRate.sleep();
+    // feedback is published by publishFeedback() at feedback_rate
   }
   // node is shutting down, n.ok() returned false
   ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: action: node shutting down, setting aborted state and ending execution.");
-  actionServer.setAborted(move_base_msgs::MoveBaseResult(), "Setting aborted state since node is shutting down.");
   action_executing = false;
+  if(actionServer.isActive())
+    actionServer.setAborted(move_base_msgs::MoveBaseResult(), "Setting aborted state since node is shutting down.");
 }
 
-void RosArnlNode::arnl_goal_reached_cb(ArPose p)
+void RosArnlNode::action_preempt_cb()
 {
-  if(action_executing)
   {
-    ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: action: goal succeeded");
-    actionServer.setSucceeded(move_base_msgs::MoveBaseResult(), "Goal succeeded");
-  }
-  else {
-    puts("action not executing");
+    std::lock_guard<std::mutex> lock(action_mutex);
+    action_preempt_signalled = true;
   }
-  arnl_goal_done = true;
+  action_cond.notify_all();
 }
 
-void RosArnlNode::arnl_goal_failed_cb(ArPose p)
+void RosArnlNode::signal_action_outcome(int outcome, const ArPose& p)
 {
-  if(action_executing)
   {
-    ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: action: goal failed");
-    actionServer.setAborted(move_base_msgs::MoveBaseResult(), "Goal failed");
+    std::lock_guard<std::mutex> lock(action_mutex);
+    if(!action_executing)
+      return;
+    // ignore callbacks about some other goal
+    if(fabs(p.getX() - action_goal_x) > 10 || fabs(p.getY() - action_goal_y) > 10)
+      return;
+    action_outcome = outcome;
   }
-  arnl_goal_done = true;
+  action_cond.notify_all();
+}
+
+void RosArnlNode::arnl_goal_reached_cb(ArPose p)
+{
+  signal_action_outcome(ActionOutcomeSucceeded, p);
+}
+
+void RosArnlNode::arnl_goal_failed_cb(ArPose p)
+{
+  signal_action_outcome(ActionOutcomeFailed, p);
 }
 
 void RosArnlNode::arnl_goal_interrupted_cb(ArPose p)
 {
-  if(action_executing)
-  {
-    ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: action: goal interrupted");
-    actionServer.setPreempted();
-  }
+  signal_action_outcome(ActionOutcomeInterrupted, p);
 }
 
 void RosArnlNode::cmdvel_cb( const geometry_msgs::TwistConstPtr &msg)
 {
-  ros::Time veltime = ros::Time::now();
-  ROS_INFO( "new speed: [%0.2f,%0.2f](%0.3f)", msg->linear.x*1e3, msg->angular.z, veltime.toSec() );
-  
-  arnl.robot->lock();
-  arnl.robot->setVel(msg->linear.x*1e3);
-  if(arnl.robot->hasLatVel())
-    arnl.robot->setLatVel(msg->linear.y*1e3);
-  arnl.robot->setRotVel(msg->angular.z*180/M_PI);
-  arnl.robot->unlock();
-  ROS_DEBUG("RosArnl: sent vels to Arnl (time %f): x vel %f mm/s, y vel %f mm/s, ang vel %f deg/s", veltime.toSec(), 
+  LatencyScope timer(cmd_vel_cb_latency);
+  // Don't lock the robot here, just leave the command for cmdVelTask().
+  cmd_vel_mailbox.write(msg->linear.x*1e3, msg->linear.y*1e3, msg->angular.z*180/M_PI, CmdVelMailbox::Clock::now());
+  ROS_DEBUG("RosArnl: received vels: x vel %f mm/s, y vel %f mm/s, ang vel %f deg/s",
     (double) msg->linear.x * 1e3, (double) msg->linear.y * 1e3, (double) msg->angular.z * 180/M_PI);
 }
 
+void RosArnlNode::cmdVelTask()
+{
+  // Note, this is called as an ArRobot user task (myCmdVelCB, named
+  // "ROSCmdVelTask"), so the robot is already locked.
+  CmdVelMailbox::Command cmd;
+  if(!cmd_vel_mailbox.read(cmd))
+    return;
+
+  const CmdVelMailbox::Clock::time_point now = CmdVelMailbox::Clock::now();
+
+  if(cmd.seq != cmd_vel_applied_seq)
+  {
+    arnl.robot->setVel(cmd.vel);
+    if(arnl.robot->hasLatVel())
+      arnl.robot->setLatVel(cmd.latVel);
+    arnl.robot->setRotVel(cmd.rotVel);
+    cmd_vel_applied_seq = cmd.seq;
+    cmd_vel_driving = (cmd.vel != 0 || cmd.latVel != 0 || cmd.rotVel != 0);
+
+    cmd_vel_apply_latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - cmd.received).count());
+    return;
+  }
+
+  // No new command. If the last one left the robot moving, make sure the
+  // sender is still alive.
+  const double timeout = config.get().cmd_vel_timeout;
+  if(cmd_vel_driving && timeout > 0 && now - cmd.received > std::chrono::duration<double>(timeout))
+  {
+    arnl.robot->stop();
+    cmd_vel_driving = false;
+    ROS_WARN_NAMED("rosarnl_node", "rosarnl_node: No cmd_vel received for %.2f sec, stopping robot.", timeout);
+  }
+}
+
+void RosArnlNode::publishDiagnostics()
+{
+  // One status per histogram, summarizing what was recorded since the last
+  // report.
+  diagnostic_msgs::DiagnosticArray msg;
+  msg.header.stamp = ros::Time::now();
+  LatencyRegistry::instance().forEach([&msg](LatencyHistogram& h) {
+    const LatencyHistogram::Summary s = h.takeSummary();
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = "rosarnl_node: " + h.getName() + " latency";
+    status.hardware_id = "rosarnl_node";
+    char buf[128];
+    snprintf(buf, sizeof(buf), "p50 %.3f ms, p99 %.3f ms, max %.3f ms (%llu samples)", s.p50_ms, s.p99_ms, s.max_ms, (unsigned long long)s.count);
+    status.message = buf;
+    diagnostic_msgs::KeyValue kv;
+    kv.key = "count";  snprintf(buf, sizeof(buf), "%llu", (unsigned long long)s.count);  kv.value = buf;  status.values.push_back(kv);
+    kv.key = "p50_ms"; snprintf(buf, sizeof(buf), "%.3f", s.p50_ms); kv.value = buf; status.values.push_back(kv);
+    kv.key = "p99_ms"; snprintf(buf, sizeof(buf), "%.3f", s.p99_ms); kv.value = buf; status.values.push_back(kv);
+    kv.key = "max_ms"; snprintf(buf, sizeof(buf), "%.3f", s.max_ms); kv.value = buf; status.values.push_back(kv);
+    msg.status.push_back(status);
+  });
+
+  // Quality of the ArTime to ROS time mapping. Jitter is limited by ArTime's
+  // 1 ms resolution; a stale mapping means the clock sync stream stopped.
+  const ClockMapping::Quality q = ClockMapping::instance().getQuality();
+  const double stale_age = 5.0 / config.get().clock_sync_rate;
+  diagnostic_msgs::DiagnosticStatus status;
+  status.name = "rosarnl_node: clock mapping";
+  status.hardware_id = "rosarnl_node";
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.message = "OK";
+  if(q.age > stale_age)
+  {
+    status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+    status.message = "Not updated recently";
+  }
+  else if(q.jitter_ms > 5.0)
+  {
+    status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+    status.message = "High jitter";
+  }
+  char buf[64];
+  diagnostic_msgs::KeyValue kv;
+  kv.key = "jitter_ms";   snprintf(buf, sizeof(buf), "%.3f", q.jitter_ms);   kv.value = buf; status.values.push_back(kv);
+  kv.key = "residual_ms"; snprintf(buf, sizeof(buf), "%.3f", q.residual_ms); kv.value = buf; status.values.push_back(kv);
+  kv.key = "drift_ppm";   snprintf(buf, sizeof(buf), "%.2f", q.drift_ppm);   kv.value = buf; status.values.push_back(kv);
+  kv.key = "read_gap_ms"; snprintf(buf, sizeof(buf), "%.3f", q.read_gap_ms); kv.value = buf; status.values.push_back(kv);
+  kv.key = "age";         snprintf(buf, sizeof(buf), "%.2f", q.age);         kv.value = buf; status.values.push_back(kv);
+  kv.key = "samples";     snprintf(buf, sizeof(buf), "%lu", q.samples);      kv.value = buf; status.values.push_back(kv);
+  kv.key = "resets";      snprintf(buf, sizeof(buf), "%lu", q.resets);       kv.value = buf; status.values.push_back(kv);
+  msg.status.push_back(status);
+
+  // Time since ARNL last localized. Poses are still carried forward by
+  // odometry in between, so a long age is expected while the robot is stopped.
+  const double loc_age = arnl.locTask->getLastLocaTime().mSecSince() / 1000.0;
+  diagnostic_msgs::DiagnosticStatus loc_status;
+  loc_status.name = "rosarnl_node: localization";
+  loc_status.hardware_id = "rosarnl_node";
+  loc_status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  snprintf(buf, sizeof(buf), "Last localized %.1f sec ago", loc_age);
+  loc_status.message = buf;
+  kv.key = "age"; snprintf(buf, sizeof(buf), "%.3f", loc_age); kv.value = buf; loc_status.values.push_back(kv);
+  msg.status.push_back(loc_status);
+
+  diagnostics_pub.publish(msg);
+}
+
+void RosArnlNode::updateClockMapping()
+{
+  ClockMapping::instance().update();
+}
 
 void RosArnlNode::shutdown_rosarnl_cb(const std_msgs::EmptyConstPtr &msg)
 {
   std_msgs::Empty confirm_msg;
-  shutdown_requested = true;
+  {
+    std::lock_guard<std::mutex> lock(shutdown_mutex);
+    shutdown_requested = true;
+  }
+  shutdown_cond.notify_all();
   arnl_shutdown_confirm_pub.publish(confirm_msg);
 }
 
@@ -741,16 +1240,29 @@ int main( int argc, char** argv )
     return -1;
   }
 
+  // A copy, as it is used through the rest of startup.
+  const RosArnlConfig cfg = node->getConfig();
+  MergedScanPublisher *merged = NULL;
+  if(cfg.merged_scan)
+    merged = new MergedScanPublisher(n, cfg.frame_id_base_link, cfg.merged_scan_window, cfg.merged_scan_resolution);
+
   arnl.robot->lock();
   const std::map<int, ArLaser*> *lasers = arnl.robot->getLaserMap();
   for(std::map<int, ArLaser*>::const_iterator i = lasers->begin(); i != lasers->end(); ++i)
   {
     ArLaser *l = i->second;
     ROS_INFO_NAMED("rosarnl_node", "rosarnl_node: Creating publisher for laser %s\n", l->getName());
-    new LaserPublisher(l, n);
+    // Each laser gets its own frame, named after the laser
+    LaserPublisher *lp = new LaserPublisher(l, n, node->getStaticTransformBroadcaster(), tf::resolve(cfg.tf_prefix, l->getName()), cfg.frame_id_base_link, cfg.frame_id_map);
+    lp->setAdaptiveRate(cfg.link_quality_full_rate, cfg.max_scan_skip);
+    lp->setCumulativeKeyframeInterval(cfg.cumulative_keyframe_interval);
+    if(merged)
+      lp->setMergedScanPublisher(merged);
   }
   arnl.robot->unlock();
 
+  new SonarPublisher(arnl.robot, n, node->getStaticTransformBroadcaster(), cfg.frame_id_base_link, cfg.frame_id_sonar);
+
   node->spin();
   
   delete node;  
@@ -0,0 +1,214 @@
+// Micro-benchmark for how long LaserPublisher holds the laser's device lock
+// per scan: the old readingsCB(), which built the LaserScan and point clouds
+// and published (serialized) them under lockDevice(), against the current
+// one, which only copies the raw readings into a LaserCapture. Uses stand-ins
+// for ArSensorReading, ArPoseWithTime and ros::Publisher::publish() (one
+// serialization into a new buffer, as for a single TCP subscriber), so it
+// needs neither ARIA nor a ROS master. Not run as a test; run by hand on the
+// target machine:
+//
+//   rosrun rosarnl bench_laser_lock_hold   (or devel/lib/rosarnl/...)
+
+#include "rosarnl/RangeConversion.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// Stand-in for ArSensorReading: range and ignore flag, with the poses,
+// times and counters around them as in the real class.
+struct Reading
+{
+  double pose[3], localPose[3], encoderPose[3], sensorPos[3];
+  unsigned int range;
+  long long time;
+  unsigned int counterTaken;
+  int extraInt;
+  bool ignore;
+  double extra[4];
+};
+
+// Stand-in for ArPoseWithTime
+struct BufferPoint
+{
+  double x, y, th;
+  long long time;
+};
+
+struct Point32 { float x, y, z; };
+
+// The node's messages, as far as the locked section touched them
+struct OldMessages
+{
+  std::vector<float> ranges;
+  std::vector<Point32> points;
+  std::vector<unsigned char> cloud2;
+};
+
+// The current LaserCapture
+struct Capture
+{
+  long long time;
+  bool flipped;
+  std::vector<uint32_t> ranges, ignore_mask;
+  std::vector<int> intensities;
+  bool have_cloud;
+  std::vector<double> cloud_xy;
+};
+
+// Stand-in for ros::Publisher::publish() with one remote subscriber: the
+// message is serialized into a newly allocated buffer.
+volatile unsigned char sink;
+void serialize(const void *data, size_t bytes)
+{
+  std::unique_ptr<unsigned char[]> buf(new unsigned char[bytes + 64]);
+  memcpy(buf.get() + 64, data, bytes);
+  sink = buf[64 + bytes / 2];
+}
+
+void oldLockedSection(const std::list<Reading*>& readings, const std::list<BufferPoint*>& buffer, bool flipped, bool want_cloud, OldMessages& m)
+{
+  m.ranges.resize(readings.size());
+  size_t n = 0;
+  if(flipped)
+  {
+    for(std::list<Reading*>::const_reverse_iterator r = readings.rbegin(); r != readings.rend(); ++r)
+      m.ranges[n++] = (*r)->ignore ? -1 : (*r)->range / 1000.0;
+  }
+  else
+  {
+    for(std::list<Reading*>::const_iterator r = readings.begin(); r != readings.end(); ++r)
+      m.ranges[n++] = (*r)->ignore ? -1 : (*r)->range / 1000.0;
+  }
+  serialize(m.ranges.data(), m.ranges.size() * sizeof(float));
+
+  if(!want_cloud)
+    return;
+  m.points.resize(buffer.size());
+  n = 0;
+  for(std::list<BufferPoint*>::const_iterator i = buffer.begin(); i != buffer.end(); ++i, ++n)
+  {
+    m.points[n].x = (*i)->x / 1000.0;
+    m.points[n].y = (*i)->y / 1000.0;
+    m.points[n].z = 0.3f;
+  }
+  serialize(m.points.data(), m.points.size() * sizeof(Point32));
+  m.cloud2.resize(buffer.size() * sizeof(Point32));
+  unsigned char *out = m.cloud2.data();
+  for(std::list<BufferPoint*>::const_iterator i = buffer.begin(); i != buffer.end(); ++i)
+  {
+    const float xyz[3] = { (float)((*i)->x / 1000.0), (float)((*i)->y / 1000.0), 0.3f };
+    memcpy(out, xyz, sizeof(xyz));
+    out += sizeof(xyz);
+  }
+  serialize(m.cloud2.data(), m.cloud2.size());
+}
+
+void newLockedSection(const std::list<Reading*>& readings, const std::list<BufferPoint*>& buffer, bool flipped, bool want_cloud, Capture& c)
+{
+  c.time = readings.front()->time;
+  c.flipped = flipped;
+  c.ranges.resize(readings.size());
+  c.ignore_mask.assign(rangeIgnoreMaskWords(readings.size()), 0);
+  c.intensities.resize(readings.size());
+  size_t n = 0;
+  for(std::list<Reading*>::const_iterator r = readings.begin(); r != readings.end(); ++r)
+  {
+    c.ranges[n] = (*r)->range;
+    setRangeIgnored(c.ignore_mask.data(), n, (*r)->ignore);
+    c.intensities[n] = (*r)->extraInt;
+    ++n;
+  }
+
+  c.have_cloud = want_cloud;
+  c.cloud_xy.clear();
+  if(!want_cloud)
+    return;
+  c.cloud_xy.resize(2 * buffer.size());
+  n = 0;
+  for(std::list<BufferPoint*>::const_iterator i = buffer.begin(); i != buffer.end(); ++i)
+  {
+    c.cloud_xy[n++] = (*i)->x / 1000.0;
+    c.cloud_xy[n++] = (*i)->y / 1000.0;
+  }
+}
+
+// Times the section from lock to unlock, as the "<laser> lockDevice hold"
+// histogram does. Returns the mean and the 99th percentile in microseconds.
+template<class F> void holdTimes(std::mutex& device, F f, int iterations, double& mean_us, double& p99_us)
+{
+  typedef std::chrono::steady_clock Clock;
+  std::vector<double> us(iterations);
+  for(int i = 0; i < iterations / 10; ++i)
+  {
+    std::lock_guard<std::mutex> lock(device);
+    f();
+  }
+  double total = 0;
+  for(int i = 0; i < iterations; ++i)
+  {
+    device.lock();
+    const Clock::time_point start = Clock::now();
+    f();
+    us[i] = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    device.unlock();
+    total += us[i];
+  }
+  mean_us = total / iterations;
+  std::sort(us.begin(), us.end());
+  p99_us = us[iterations * 99 / 100];
+}
+
+}
+
+int main()
+{
+  const size_t sizes[] = { 181, 541, 1081 };
+  const int iterations = 20000;
+  std::mutex device;
+
+  printf("%8s %6s %12s %12s %12s %12s\n", "beams", "cloud", "old mean us", "old p99 us", "new mean us", "new p99 us");
+  for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+  {
+    const size_t n = sizes[s];
+    srand(1);
+    // ARIA allocates readings and buffer points one by one, interleaved
+    // with its other allocations; keep them apart the same way.
+    std::vector<std::unique_ptr<Reading> > reading_storage;
+    std::vector<std::unique_ptr<BufferPoint> > point_storage;
+    std::vector<std::unique_ptr<char[]> > spacers;
+    std::list<Reading*> readings;
+    std::list<BufferPoint*> buffer;
+    for(size_t i = 0; i < n; ++i)
+    {
+      reading_storage.emplace_back(new Reading());
+      reading_storage.back()->range = 200 + rand() % 30000;
+      reading_storage.back()->ignore = (rand() % 20) == 0;
+      readings.push_back(reading_storage.back().get());
+      spacers.emplace_back(new char[48 + rand() % 128]);
+      point_storage.emplace_back(new BufferPoint());
+      point_storage.back()->x = rand() % 30000;
+      point_storage.back()->y = rand() % 30000;
+      buffer.push_back(point_storage.back().get());
+    }
+
+    for(int want_cloud = 0; want_cloud < 2; ++want_cloud)
+    {
+      OldMessages m;
+      Capture c;
+      double old_mean, old_p99, new_mean, new_p99;
+      holdTimes(device, [&] { oldLockedSection(readings, buffer, true, want_cloud, m); }, iterations, old_mean, old_p99);
+      holdTimes(device, [&] { newLockedSection(readings, buffer, true, want_cloud, c); }, iterations, new_mean, new_p99);
+      printf("%8zu %6s %12.2f %12.2f %12.2f %12.2f\n", n, want_cloud ? "yes" : "no", old_mean, old_p99, new_mean, new_p99);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,91 @@
+// Micro-benchmark for convertRanges() at common laser scan sizes (SICK LMS
+// 1xx/2xx at 1 deg and 0.5 deg, LMS 5xx/TiM at 0.25 deg), against a
+// per-reading loop over a linked list, which is how ARIA hands LaserPublisher
+// its raw readings. Not run as a test; run by hand on the target machine:
+//
+//   rosrun rosarnl bench_range_conversion   (or devel/lib/rosarnl/...)
+
+#include "rosarnl/RangeConversion.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <vector>
+
+namespace {
+
+// Stand-in for ArSensorReading: range plus ignore flag, with other fields
+// around it as in the real class.
+struct Reading
+{
+  double x, y, th;
+  unsigned int range;
+  bool ignore;
+  double extra[4];
+};
+
+void listConvert(const std::list<Reading*>& readings, bool flipped, float range_min, float range_max, float *out)
+{
+  const size_t n = readings.size();
+  size_t i = 0;
+  for(std::list<Reading*>::const_iterator it = readings.begin(); it != readings.end(); ++it, ++i)
+  {
+    float r = -1;
+    if(!(*it)->ignore)
+      r = std::min(std::max((*it)->range / 1000.0f, range_min), range_max);
+    out[flipped ? n - 1 - i : i] = r;
+  }
+}
+
+template<class F> double nsPerCall(F f, int iterations)
+{
+  typedef std::chrono::steady_clock Clock;
+  // warm up caches and branch predictors
+  for(int i = 0; i < iterations / 10; ++i)
+    f();
+  const Clock::time_point start = Clock::now();
+  for(int i = 0; i < iterations; ++i)
+    f();
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+}
+
+}
+
+int main()
+{
+  const size_t sizes[] = { 181, 541, 1081 };
+  const int iterations = 200000;
+  volatile float sink = 0;
+
+  printf("%8s %14s %14s %8s\n", "beams", "list ns/scan", "kernel ns/scan", "speedup");
+  for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+  {
+    const size_t n = sizes[s];
+    srand(1);
+    std::vector<Reading> storage(n);
+    std::list<Reading*> readings;
+    std::vector<uint32_t> mm(n), mask(rangeIgnoreMaskWords(n), 0);
+    for(size_t i = 0; i < n; ++i)
+    {
+      storage[i].range = mm[i] = 200 + rand() % 30000;
+      storage[i].ignore = (rand() % 20) == 0;
+      setRangeIgnored(mask.data(), i, storage[i].ignore);
+      readings.push_back(&storage[i]);
+    }
+    std::vector<float> out(n);
+
+    const double list_ns = nsPerCall([&] {
+      listConvert(readings, true, 0, 30, out.data());
+      sink = sink + out[n / 2];
+    }, iterations);
+    const double kernel_ns = nsPerCall([&] {
+      convertRanges(mm.data(), mask.data(), n, true, 0, 30, out.data());
+      sink = sink + out[n / 2];
+    }, iterations);
+
+    printf("%8zu %14.1f %14.1f %7.1fx\n", n, list_ns, kernel_ns, list_ns / kernel_ns);
+  }
+  return 0;
+}
@@ -0,0 +1,198 @@
+// Built with ROSARNL_ALLOC_CHECK (see CMakeLists.txt) so that AllocationCheck
+// counts heap allocations. Runs the message building functions that the node
+// and LaserPublisher wrap in AllocationCheck (pose, tf, odometry, feedback,
+// state strings, LaserScan and CompactScan) on reused messages, as the node
+// does in steady state.
+
+#include "rosarnl/AllocationCheck.h"
+#include "rosarnl/LaserScanBuilder.h"
+#include "rosarnl/RangeConversion.h"
+#include "rosarnl/StateMessages.h"
+
+#include <geometry_msgs/PoseStamped.h>
+#include <geometry_msgs/PoseWithCovarianceStamped.h>
+#include <geometry_msgs/TransformStamped.h>
+#include <nav_msgs/Odometry.h>
+#include <sensor_msgs/LaserScan.h>
+#include <std_msgs/String.h>
+#include <rosarnl/CompactScan.h>
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <vector>
+
+#ifndef ROSARNL_ALLOC_CHECK
+#error test_allocation_check must be built with ROSARNL_ALLOC_CHECK
+#endif
+
+// Run @a cycle @a n times inside an AllocationCheck that allows one warm-up
+// cycle, and return the allocations made after it.
+template<class F> static unsigned long steadyAllocations(const char *name, int n, F cycle)
+{
+  AllocationCheck check(name, 1);
+  unsigned long steady = 0;
+  for(int i = 0; i < n; ++i)
+  {
+    const unsigned long before = AllocationCheck::threadAllocations();
+    check.begin();
+    cycle(i);
+    check.end();
+    if(i > 0)
+      steady += AllocationCheck::threadAllocations() - before;
+  }
+  return steady;
+}
+
+static RobotStateSnapshot makeSnapshot(int i)
+{
+  RobotStateSnapshot snap;
+  snap.x = 1000 + i;
+  snap.y = -2000 + 2 * i;
+  snap.th = (i * 7) % 360 - 180;
+  snap.encX = 900 + i;
+  snap.encY = -1900 + i;
+  snap.encTh = (i * 5) % 360 - 180;
+  snap.vel = 300;
+  snap.rotVel = 10;
+  strcpy(snap.serverMode, (i & 1) ? "Goto goal" : "Stop");
+  strcpy(snap.serverStatus, (i & 2) ? "Going to goal Charger" : "Stopped");
+  return snap;
+}
+
+// Stops the compiler from eliding a new/delete pair
+static int * volatile sink;
+
+TEST(AllocationCheck, CountsThreadAllocations)
+{
+  const unsigned long before = AllocationCheck::threadAllocations();
+  sink = new int[16];
+  delete[] sink;
+  EXPECT_EQ(before + 1, AllocationCheck::threadAllocations());
+}
+
+TEST(AllocationCheck, PosePathDoesNotAllocate)
+{
+  const std::string map_frame("map");
+  geometry_msgs::PoseWithCovarianceStamped pose;
+  geometry_msgs::PoseStamped feedback;
+  EXPECT_EQ(0u, steadyAllocations("test pose", 100, [&](int i) {
+    const RobotStateSnapshot snap = makeSnapshot(i);
+    pose.header.stamp = ros::Time(1000 + i);
+    pose.header.frame_id = map_frame;
+    fillPose(snap, pose.pose.pose);
+    feedback.header = pose.header;
+    fillPose(snap, feedback.pose);
+  }));
+}
+
+TEST(AllocationCheck, TransformAndOdometryPathDoesNotAllocate)
+{
+  const std::string map_frame("map"), odom_frame("odom"), base_frame("base_link");
+  geometry_msgs::TransformStamped map_odom, odom_base;
+  nav_msgs::Odometry odom;
+  EXPECT_EQ(0u, steadyAllocations("test tf", 100, [&](int i) {
+    const RobotStateSnapshot snap = makeSnapshot(i);
+    map_odom.header.stamp = ros::Time(1000 + i);
+    map_odom.header.frame_id = map_frame;
+    map_odom.child_frame_id = odom_frame;
+    fillMapToOdom(snap, map_odom.transform);
+    odom_base.header.stamp = map_odom.header.stamp;
+    odom_base.header.frame_id = odom_frame;
+    odom_base.child_frame_id = base_frame;
+    odom.header = odom_base.header;
+    odom.child_frame_id = base_frame;
+    fillOdometry(snap, odom_base.transform, odom);
+  }));
+}
+
+TEST(AllocationCheck, StateStringsDoNotAllocate)
+{
+  // Reserved as in RosArnlNode's constructor
+  std_msgs::String mode, status;
+  mode.data.reserve(sizeof(RobotStateSnapshot().serverMode));
+  status.data.reserve(sizeof(RobotStateSnapshot().serverStatus));
+  int changes = 0;
+  EXPECT_EQ(0u, steadyAllocations("test state strings", 100, [&](int i) {
+    const RobotStateSnapshot snap = makeSnapshot(i);
+    changes += updateStateString(snap.serverMode, mode);
+    changes += updateStateString(snap.serverStatus, status);
+  }));
+  EXPECT_GT(changes, 100);
+}
+
+TEST(AllocationCheck, LaserScanPathDoesNotAllocate)
+{
+  const size_t n = 541;
+  std::vector<uint32_t> mm(n), mask(rangeIgnoreMaskWords(n), 0);
+  std::vector<int> intensities(n);
+  for(size_t i = 0; i < n; ++i)
+  {
+    mm[i] = 500 + 7 * i;
+    intensities[i] = i % 3;
+  }
+  setRangeIgnored(mask.data(), 10, true);
+
+  LaserScanBuilder builder;
+  builder.angle_min = -2.356;
+  builder.angle_max = 2.356;
+  builder.angle_increment = 0.00872;
+  builder.range_max = 20.0;
+  builder.crop_max = 15.0;
+  builder.decimation = 2;
+
+  sensor_msgs::LaserScan scan;
+  rosarnl::CompactScan compact;
+  scan.header.frame_id = "lms5xx_1";
+  compact.header.frame_id = scan.header.frame_id;
+  EXPECT_EQ(0u, steadyAllocations("test laser scan", 100, [&](int i) {
+    scan.header.stamp = ros::Time(1000 + i);
+    // A short scan now and then, as a laser may return after an error
+    const size_t size = (i % 10 == 5) ? n / 2 : n;
+    builder.build(mm.data(), mask.data(), size, i & 1, intensities.data(), size, 0.05, scan);
+    compact.header.stamp = scan.header.stamp;
+    compact.count = scan.ranges.size();
+    compact.ranges.resize(compactRangesMaxBytes(scan.ranges.size()));
+    compact.ranges.resize(encodeCompactRanges(scan.ranges.data(), scan.ranges.size(), compact.ranges.data()));
+  }));
+}
+
+TEST(AllocationCheckDeathTest, AbortsOnSteadyStateAllocation)
+{
+  ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+  EXPECT_DEATH({
+    AllocationCheck check("test allocating path", 2);
+    for(int cycle = 0; cycle < 3; ++cycle)
+    {
+      check.begin();
+      std::vector<int> v(16);
+      check.end();
+    }
+  }, "");
+}
+
+TEST(AllocationCheck, WarmupMayAllocate)
+{
+  // Growing a buffer in the allowed warm-up cycles must not abort.
+  std::vector<float> buffer;
+  unsigned long warmup = 0;
+  AllocationCheck check("test warm-up", 3);
+  for(int cycle = 0; cycle < 10; ++cycle)
+  {
+    const unsigned long before = AllocationCheck::threadAllocations();
+    check.begin();
+    if(cycle < 3)
+      buffer.reserve(64 << cycle);
+    buffer.resize(64);
+    check.end();
+    if(cycle < 3)
+      warmup += AllocationCheck::threadAllocations() - before;
+  }
+  EXPECT_EQ(3u, warmup);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,64 @@
+#include "rosarnl/ClockMapping.h"
+
+#include <gtest/gtest.h>
+
+// ClockMapping is a singleton, so each test starts from a ROS time far from
+// the previous one. The first sample then restarts the filter (one reset),
+// as a clock step would.
+static void start(ClockMapping& m, double aria, double ros_sec, unsigned long& resets)
+{
+  m.addSample(aria, ros_sec, 0.0001);
+  resets = m.getQuality().resets;
+}
+
+TEST(ClockMapping, TracksSteadySlowClock)
+{
+  // Simulation running at a real time factor of 0.9, updated at 1 Hz
+  ClockMapping& m = ClockMapping::instance();
+  unsigned long resets;
+  start(m, 1000.0, 1e6, resets);
+  for(int i = 1; i <= 60; ++i)
+    m.addSample(1000.0 + i, 1e6 + 0.9 * i, 0.0001);
+  const ClockMapping::Quality q = m.getQuality();
+  EXPECT_EQ(resets, q.resets);
+  EXPECT_NEAR(-100000.0, q.drift_ppm, 10.0);
+  EXPECT_NEAR(0.0, q.residual_ms, 0.1);
+}
+
+TEST(ClockMapping, TracksJitteryClock)
+{
+  ClockMapping& m = ClockMapping::instance();
+  unsigned long resets;
+  start(m, 2000.0, 2e6, resets);
+  for(int i = 1; i <= 60; ++i)
+    m.addSample(2000.0 + i, 2e6 + 1.00005 * i + ((i % 3) - 1) * 0.002, 0.0001);
+  const ClockMapping::Quality q = m.getQuality();
+  EXPECT_EQ(resets, q.resets);
+  EXPECT_NEAR(50.0, q.drift_ppm, 500.0);
+}
+
+TEST(ClockMapping, RestartsOnStep)
+{
+  ClockMapping& m = ClockMapping::instance();
+  unsigned long resets;
+  start(m, 3000.0, 3e6, resets);
+  for(int i = 1; i <= 10; ++i)
+    m.addSample(3000.0 + i, 3e6 + 0.9 * i, 0.0001);
+  EXPECT_EQ(resets, m.getQuality().resets);
+
+  // Clock jumps back 0.3 sec, then runs on at the same rate
+  for(int i = 11; i <= 20; ++i)
+    m.addSample(3000.0 + i, 3e6 + 0.9 * i - 0.3, 0.0001);
+  const ClockMapping::Quality q = m.getQuality();
+  EXPECT_EQ(resets + 1, q.resets);
+  EXPECT_NEAR(-100000.0, q.drift_ppm, 10.0);
+  EXPECT_NEAR(0.0, q.residual_ms, 0.1);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  // ClockMapping samples the ROS clock when it is created
+  ros::Time::init();
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,83 @@
+#include "rosarnl/PoseHistory.h"
+
+#include <gtest/gtest.h>
+
+static PoseSample sample(double t, double x)
+{
+  PoseSample s;
+  s.t = t;
+  s.x = x;
+  return s;
+}
+
+TEST(PoseHistory, EmptyUntilAdded)
+{
+  PoseHistory h;
+  PoseSample p;
+  EXPECT_FALSE(h.latest(p));
+  EXPECT_FALSE(h.interpolate(0, p));
+  h.add(sample(10.0, 1.0));
+  ASSERT_TRUE(h.latest(p));
+  EXPECT_EQ(10.0, p.t);
+}
+
+TEST(PoseHistory, Interpolates)
+{
+  PoseHistory h;
+  for(int i = 0; i <= 10; ++i)
+    h.add(sample(100.0 + 0.1 * i, i));
+  PoseSample p;
+  ASSERT_TRUE(h.interpolate(100.55, p));
+  EXPECT_NEAR(5.5, p.x, 1e-9);
+  EXPECT_FALSE(h.interpolate(99.0, p));
+  EXPECT_FALSE(h.interpolate(102.0, p));
+}
+
+TEST(PoseHistory, KeepsLastCapacitySamples)
+{
+  PoseHistory h;
+  const int n = 3 * PoseHistory::Capacity;
+  for(int i = 0; i < n; ++i)
+    h.add(sample(i, i));
+  PoseSample p;
+  EXPECT_FALSE(h.interpolate(n - PoseHistory::Capacity - 1, p));
+  ASSERT_TRUE(h.interpolate(n - 10.5, p));
+  EXPECT_NEAR(n - 10.5, p.x, 1e-9);
+}
+
+TEST(PoseHistory, IgnoresRepeatedTime)
+{
+  PoseHistory h;
+  h.add(sample(5.0, 1.0));
+  h.add(sample(5.0, 2.0));
+  PoseSample p;
+  ASSERT_TRUE(h.latest(p));
+  EXPECT_EQ(1.0, p.x);
+}
+
+TEST(PoseHistory, ClearsWhenTimeGoesBackwards)
+{
+  PoseHistory h;
+  for(int i = 0; i < 20; ++i)
+    h.add(sample(1000.0 + i, i));
+
+  // e.g. simulation restarted
+  h.add(sample(3.0, 100.0));
+  PoseSample p;
+  ASSERT_TRUE(h.latest(p));
+  EXPECT_EQ(3.0, p.t);
+  EXPECT_FALSE(h.interpolate(1010.0, p));
+
+  // and keeps recording on the new time line
+  h.add(sample(4.0, 101.0));
+  ASSERT_TRUE(h.latest(p));
+  EXPECT_EQ(4.0, p.t);
+  ASSERT_TRUE(h.interpolate(3.5, p));
+  EXPECT_NEAR(100.5, p.x, 1e-9);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,79 @@
+#include "rosarnl/PublishScheduler.h"
+
+#include <boost/bind/bind.hpp>
+#include <gtest/gtest.h>
+
+typedef PublishScheduler::Clock Clock;
+
+static void count(int *n)
+{
+  ++*n;
+}
+
+TEST(PublishScheduler, RunsEachStreamOncePerPeriod)
+{
+  PublishScheduler s;
+  int fast = 0, slow = 0;
+  s.addStream("fast", 10.0, boost::bind(&count, &fast));
+  s.addStream("slow", 1.0, boost::bind(&count, &slow));
+  const Clock::time_point start = Clock::now();
+  for(int ms = 0; ms <= 2000; ms += 10)
+    s.runDue(start + std::chrono::milliseconds(ms));
+  EXPECT_EQ(21, fast);
+  EXPECT_EQ(3, slow);
+}
+
+TEST(PublishScheduler, SkipsMissedPeriods)
+{
+  PublishScheduler s;
+  int n = 0;
+  const int id = s.addStream("s", 10.0, boost::bind(&count, &n));
+  const Clock::time_point start = Clock::now();
+  s.runDue(start);
+  s.runDue(start + std::chrono::milliseconds(550));
+  EXPECT_EQ(2, n);
+  EXPECT_EQ(4u, s.getMissed(id));
+}
+
+TEST(PublishScheduler, ShorterPeriodAppliesImmediately)
+{
+  PublishScheduler s;
+  int n = 0;
+  const int id = s.addStream("battery", 1.0 / 60.0, boost::bind(&count, &n));
+  const Clock::time_point start = Clock::now();
+  s.runDue(start);
+  EXPECT_EQ(1, n);
+
+  // Without rescheduling this would wait for the old deadline, a minute on.
+  s.setRate(id, 1.0);
+  const Clock::time_point next = s.runDue(start + std::chrono::milliseconds(500));
+  EXPECT_EQ(start + std::chrono::seconds(1), next);
+  s.runDue(start + std::chrono::seconds(1));
+  EXPECT_EQ(2, n);
+
+  // Already overdue at the new rate: runs on the next call.
+  s.setRate(id, 1.0 / 60.0);
+  s.runDue(start + std::chrono::seconds(5));
+  s.setRate(id, 0.5);
+  s.runDue(start + std::chrono::seconds(5));
+  EXPECT_EQ(3, n);
+}
+
+TEST(PublishScheduler, EnablingStreamAppliesImmediately)
+{
+  PublishScheduler s;
+  int n = 0;
+  const int id = s.addStream("s", 0, boost::bind(&count, &n));
+  const Clock::time_point start = Clock::now();
+  s.runDue(start);
+  EXPECT_EQ(0, n);
+  s.setRate(id, 10.0);
+  s.runDue(start + std::chrono::milliseconds(1));
+  EXPECT_EQ(1, n);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,173 @@
+#include "rosarnl/RangeConversion.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+// Straightforward per-reading conversion, as LaserPublisher did before the
+// block kernel, to check convertRanges() against.
+static void referenceConvert(const std::vector<uint32_t>& mm, const std::vector<bool>& ignored, bool flipped, float range_min, float range_max, std::vector<float>& out)
+{
+  const size_t n = mm.size();
+  out.assign(n, 0);
+  for(size_t i = 0; i < n; ++i)
+  {
+    float r = -1;
+    if(!ignored[i])
+      r = std::min(std::max(mm[i] / 1000.0f, range_min), range_max);
+    out[flipped ? n - 1 - i : i] = r;
+  }
+}
+
+static std::vector<uint32_t> makeMask(const std::vector<bool>& ignored)
+{
+  std::vector<uint32_t> mask(rangeIgnoreMaskWords(ignored.size()), 0);
+  for(size_t i = 0; i < ignored.size(); ++i)
+    setRangeIgnored(mask.data(), i, ignored[i]);
+  return mask;
+}
+
+TEST(RangeConversion, ConvertsInOrderToMeters)
+{
+  const size_t n = 70;  // not a multiple of the 32 reading block
+  std::vector<uint32_t> mm(n);
+  for(size_t i = 0; i < n; ++i)
+    mm[i] = 1000 + 10 * i;
+  const std::vector<uint32_t> mask(rangeIgnoreMaskWords(n), 0);
+  std::vector<float> out(n);
+  convertRanges(mm.data(), mask.data(), n, false, 0, 30, out.data());
+  for(size_t i = 0; i < n; ++i)
+    EXPECT_FLOAT_EQ(1.0f + 0.01f * i, out[i]) << "reading " << i;
+}
+
+TEST(RangeConversion, FlippedReversesOrder)
+{
+  const size_t n = 70;
+  std::vector<uint32_t> mm(n);
+  for(size_t i = 0; i < n; ++i)
+    mm[i] = 1000 + 10 * i;
+  const std::vector<uint32_t> mask(rangeIgnoreMaskWords(n), 0);
+  std::vector<float> out(n);
+  convertRanges(mm.data(), mask.data(), n, true, 0, 30, out.data());
+  for(size_t i = 0; i < n; ++i)
+    EXPECT_FLOAT_EQ(1.0f + 0.01f * i, out[n - 1 - i]) << "reading " << i;
+}
+
+TEST(RangeConversion, IgnoreMaskMarksReadings)
+{
+  const size_t n = 100;
+  std::vector<uint32_t> mm(n, 2000);
+  std::vector<bool> ignored(n, false);
+  ignored[0] = ignored[31] = ignored[32] = ignored[63] = ignored[99] = true;
+  const std::vector<uint32_t> mask = makeMask(ignored);
+  for(int flipped = 0; flipped < 2; ++flipped)
+  {
+    std::vector<float> out(n);
+    convertRanges(mm.data(), mask.data(), n, flipped, 0, 30, out.data());
+    for(size_t i = 0; i < n; ++i)
+      EXPECT_FLOAT_EQ(ignored[i] ? -1.0f : 2.0f, out[flipped ? n - 1 - i : i]) << "reading " << i << " flipped " << flipped;
+  }
+}
+
+TEST(RangeConversion, ClampsToRange)
+{
+  const uint32_t mm[4] = { 0, 50, 5000, 80000 };
+  const uint32_t mask[1] = { 0 };
+  float out[4];
+  convertRanges(mm, mask, 4, false, 0.1f, 30.0f, out);
+  EXPECT_FLOAT_EQ(0.1f, out[0]);
+  EXPECT_FLOAT_EQ(0.1f, out[1]);
+  EXPECT_FLOAT_EQ(5.0f, out[2]);
+  EXPECT_FLOAT_EQ(30.0f, out[3]);
+}
+
+TEST(RangeConversion, MatchesReferenceAtScanSizes)
+{
+  const size_t sizes[] = { 1, 31, 32, 33, 181, 541, 1081 };
+  srand(13);
+  for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+  {
+    const size_t n = sizes[s];
+    std::vector<uint32_t> mm(n);
+    std::vector<bool> ignored(n);
+    for(size_t i = 0; i < n; ++i)
+    {
+      mm[i] = rand() % 40000;
+      ignored[i] = (rand() % 7) == 0;
+    }
+    const std::vector<uint32_t> mask = makeMask(ignored);
+    for(int flipped = 0; flipped < 2; ++flipped)
+    {
+      std::vector<float> expected, out(n);
+      referenceConvert(mm, ignored, flipped, 0.05f, 30.0f, expected);
+      convertRanges(mm.data(), mask.data(), n, flipped, 0.05f, 30.0f, out.data());
+      for(size_t i = 0; i < n; ++i)
+        ASSERT_FLOAT_EQ(expected[i], out[i]) << "size " << n << " index " << i << " flipped " << flipped;
+    }
+  }
+}
+
+TEST(CompactRanges, RoundTrip)
+{
+  // Small and large steps both ways, mm rounding, no reading, and too far
+  // for 16 bits.
+  const float ranges[] = { 1.0f, 1.001f, 1.0004f, 0.5f, 30.0f, 0.001f, -1.0f, 0.0f, 65.534f, 70.0f, 2.0f, 0.0004f };
+  const uint16_t expected[] = { 1000, 1001, 1000, 500, 30000, 1, 0, 0, 65534, 65535, 2000, 1 };
+  const size_t n = sizeof(ranges) / sizeof(ranges[0]);
+  std::vector<uint8_t> data(compactRangesMaxBytes(n));
+  data.resize(encodeCompactRanges(ranges, n, data.data()));
+  std::vector<uint16_t> mm(n);
+  ASSERT_TRUE(decodeCompactRanges(data.data(), data.size(), n, mm.data()));
+  for(size_t i = 0; i < n; ++i)
+    EXPECT_EQ(expected[i], mm[i]) << "range " << i;
+}
+
+TEST(CompactRanges, RoundTripsConvertedScan)
+{
+  const size_t n = 1081;
+  srand(16);
+  std::vector<uint32_t> raw(n);
+  std::vector<bool> ignored(n);
+  for(size_t i = 0; i < n; ++i)
+  {
+    raw[i] = rand() % 40000;
+    ignored[i] = (rand() % 10) == 0;
+  }
+  const std::vector<uint32_t> mask = makeMask(ignored);
+  std::vector<float> ranges(n);
+  convertRanges(raw.data(), mask.data(), n, false, 0, 30, ranges.data());
+
+  std::vector<uint8_t> data(compactRangesMaxBytes(n));
+  const size_t bytes = encodeCompactRanges(ranges.data(), n, data.data());
+  ASSERT_LE(bytes, compactRangesMaxBytes(n));
+  std::vector<uint16_t> mm(n);
+  ASSERT_TRUE(decodeCompactRanges(data.data(), bytes, n, mm.data()));
+  for(size_t i = 0; i < n; ++i)
+  {
+    if(ignored[i])
+      EXPECT_EQ(0, mm[i]) << "range " << i;
+    else
+      EXPECT_EQ(std::min<uint32_t>(raw[i], 30000), mm[i]) << "range " << i;
+  }
+}
+
+TEST(CompactRanges, RejectsMalformedData)
+{
+  const float ranges[] = { 1.0f, 20.0f, 0.3f };
+  uint8_t data[9];
+  const size_t bytes = encodeCompactRanges(ranges, 3, data);
+  uint16_t mm[4];
+  EXPECT_FALSE(decodeCompactRanges(data, bytes - 1, 3, mm));  // truncated
+  EXPECT_FALSE(decodeCompactRanges(data, bytes, 4, mm));      // too few ranges
+  EXPECT_FALSE(decodeCompactRanges(data, bytes, 2, mm));      // trailing bytes
+  const uint8_t overlong[] = { 0x80, 0x80, 0x80, 0x01 };
+  EXPECT_FALSE(decodeCompactRanges(overlong, sizeof(overlong), 1, mm));
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,68 @@
+#include "rosarnl/ScanTimeEstimator.h"
+
+#include <gtest/gtest.h>
+
+TEST(ScanTimeEstimator, UnknownUntilTwoStamps)
+{
+  ScanTimeEstimator e;
+  EXPECT_EQ(0.0, e.get());
+  e.addStamp(1000.0);
+  EXPECT_EQ(0.0, e.get());
+  e.addStamp(1000.1);
+  EXPECT_NEAR(0.1, e.get(), 1e-9);
+}
+
+TEST(ScanTimeEstimator, ConvergesToScanPeriod)
+{
+  ScanTimeEstimator e;
+  // Start from a bad first interval (e.g. the laser settling at startup).
+  double t = 1000.0;
+  e.addStamp(t);
+  t += 0.13;
+  e.addStamp(t);
+  for(int i = 0; i < 100; ++i)
+  {
+    t += 0.1;
+    e.addStamp(t);
+  }
+  EXPECT_NEAR(0.1, e.get(), 1e-4);
+}
+
+TEST(ScanTimeEstimator, IgnoresDroppedScans)
+{
+  ScanTimeEstimator e;
+  double t = 0;
+  for(int i = 0; i < 50; ++i, t += 0.1)
+    e.addStamp(t);
+  const double before = e.get();
+  e.addStamp(t + 0.1);  // one scan missing
+  EXPECT_DOUBLE_EQ(before, e.get());
+}
+
+TEST(ScanTimeEstimator, FollowsRateChange)
+{
+  ScanTimeEstimator e;
+  double t = 0;
+  for(int i = 0; i < 50; ++i, t += 0.05)
+    e.addStamp(t);
+  for(int i = 0; i < 50; ++i, t += 0.1)
+    e.addStamp(t);
+  EXPECT_NEAR(0.1, e.get(), 1e-4);
+}
+
+TEST(ScanTimeEstimator, IgnoresStampsThatDoNotAdvance)
+{
+  ScanTimeEstimator e;
+  e.addStamp(10.0);
+  e.addStamp(10.0);
+  e.addStamp(9.9);
+  EXPECT_EQ(0.0, e.get());
+  e.addStamp(10.1);
+  EXPECT_NEAR(0.1, e.get(), 1e-9);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
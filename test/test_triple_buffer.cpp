@@ -0,0 +1,81 @@
+#include "rosarnl/TripleBuffer.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+TEST(TripleBuffer, EmptyUntilPublished)
+{
+  TripleBuffer<int> b;
+  EXPECT_FALSE(b.fresh());
+  EXPECT_FALSE(b.take());
+  b.back() = 1;
+  EXPECT_TRUE(b.publish());
+  EXPECT_TRUE(b.fresh());
+  ASSERT_TRUE(b.take());
+  EXPECT_EQ(1, b.front());
+  EXPECT_FALSE(b.fresh());
+  EXPECT_FALSE(b.take());
+  EXPECT_EQ(1, b.front());
+}
+
+TEST(TripleBuffer, NewestReplacesUntaken)
+{
+  TripleBuffer<int> b;
+  b.back() = 1;
+  EXPECT_TRUE(b.publish());
+  b.back() = 2;
+  EXPECT_FALSE(b.publish());
+  EXPECT_EQ(1, b.back());  // the replaced value comes back to the producer
+  b.back() = 3;
+  EXPECT_FALSE(b.publish());
+  ASSERT_TRUE(b.take());
+  EXPECT_EQ(3, b.front());
+  EXPECT_EQ(2u, b.getOverwritten());
+}
+
+struct Pair
+{
+  long a, b;
+};
+
+TEST(TripleBuffer, ConsumerSeesWholeIncreasingValues)
+{
+  TripleBuffer<Pair> buf;
+  const long n = 200000;
+  std::atomic<bool> done(false);
+  std::thread producer([&] {
+    for(long i = 1; i <= n; ++i)
+    {
+      buf.back().a = i;
+      buf.back().b = -i;
+      buf.publish();
+    }
+    done = true;
+  });
+
+  long last = 0;
+  bool ok = true;
+  for(;;)
+  {
+    const bool finished = done;
+    if(buf.take())
+    {
+      const Pair& p = buf.front();
+      ok = ok && p.b == -p.a && p.a > last;
+      last = p.a;
+    }
+    else if(finished)
+      break;
+  }
+  producer.join();
+  EXPECT_TRUE(ok);
+  EXPECT_EQ(n, last);
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}